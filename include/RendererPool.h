@@ -0,0 +1,98 @@
+#pragma once
+
+#include <SynthRenderer.h>
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+
+using std::deque;
+using std::map;
+
+
+//Renders scenes on worker threads, every worker has its own renderer whose context shares background images and
+//models with the primary renderer of the pool. Results are collected in the order the scenes were submitted.
+//The pool is driven from the thread which created it
+class RendererPool
+{
+        struct Job
+        {
+            long ticket;
+            SceneSpec scene;
+            bool generate_labels;
+        };
+
+        struct PendingResult
+        {
+            SyntheticResult result;
+            std::exception_ptr error;
+        };
+
+        //Loads background images and models, its context stays current on the thread which created the pool
+        SynthRenderer primary_renderer;
+        vector< unique_ptr<SynthRenderer> > worker_renderers;
+        vector<std::thread> worker_threads;
+
+        std::mutex mutex;
+        std::condition_variable jobs_available;
+        std::condition_variable results_available;
+        deque<Job> jobs;
+        map<long, PendingResult> results;
+        unsigned int busy_workers_count = 0;
+        long next_ticket = 0;
+        long next_collect_ticket = 0;
+        bool stopping = false;
+
+        void workerLoop(SynthRenderer &renderer);
+
+        //Waits until all the submitted scenes are rendered, so the shared objects can be modified
+        void waitUntilIdle();
+
+public:
+        RendererPool(
+                unsigned int generate_image_width,
+                unsigned int generate_image_height,
+                unsigned int workers_count,
+                ContextBackend context_backend = ContextBackend::GLFW);
+
+        ~RendererPool();
+
+        unsigned int getWorkersCount() const;
+
+        //Moves the context of the primary renderer (which loads models and backgrounds) between threads, see GLContext.
+        //It is current on the creating thread after construction
+        void makeContextCurrent();
+        void releaseContext();
+
+        int addBackgroundImagesDirectory(const string &background_images_directory);
+
+        int getBackgroundImagesCount() const;
+
+        //See SynthRenderer::loadModels
+        vector<ModelHandle> loadModels(const vector<pair<string, string>> &models_aliases_to_filenames,
+                                       const HullSimplification &hull_simplification = HullSimplification());
+
+        vector< tuple<string, glm::vec3, glm::vec3> > getModelsExtent() const;
+
+        const vector<string>& getModelAliases() const;
+
+        //See SynthRenderer::setPageLockedResults
+        void setPageLockedResults(bool page_locked);
+
+        //See SynthRenderer::setLabelStatistics
+        void setLabelStatistics(bool enabled);
+
+        //Queues the scene for the first free worker, returns its ticket
+        long submitImage(const SceneSpec &scene, bool generate_labels = false);
+
+        //Waits for the oldest submitted scene which is not collected yet
+        SyntheticResult collectNextImage();
+
+        //Renders all the scenes on the workers, results are in the order of the scenes
+        vector<SyntheticResult> renderImages(const vector<SceneSpec> &scenes, bool generate_labels = false);
+};
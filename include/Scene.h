@@ -0,0 +1,109 @@
+#pragma once
+
+#include <SynthRenderer.h>
+
+#include <map>
+#include <set>
+
+
+using std::map;
+using std::set;
+
+
+//Identifier of an object of a persistent scene. Ids of removed objects are given to the objects added later, smallest
+//first, so the ids (and the instance labels, which are indexed by them) stay as dense as the objects of the scene
+typedef int ObjectId;
+
+
+//Objects kept between frames, for sequences where only a few objects change from frame to frame. Instance data of
+//the objects stays in a GPU buffer of the scene: updated objects are written into it one by one, adding and removing
+//objects re-uploads the buffer. Background and static objects are rendered once into a cached layer, which every
+//frame starts from (until the settings or a static object change), only the other objects are drawn per frame.
+//GPU objects of the scene are created in the context of the renderer which renders it first, only that renderer may
+//render the scene and its context must be current when the scene is destroyed
+class Scene
+{
+        friend class SynthRenderer;
+
+        enum Layer
+        {
+            DYNAMIC_LAYER,
+            STATIC_LAYER,
+            LAYERS_COUNT
+        };
+
+        struct SceneObject
+        {
+            ModelHandle model;
+            Layer layer;
+            ObjectAttributes attributes;
+            unsigned int instance_index;  //Position of the object among the instances of its model in its layer
+            bool dirty = false;           //Instance data changed since the last upload
+        };
+
+        //Instance data of the objects of a layer grouped by model handles, ids of the objects in the same order
+        struct SceneLayer
+        {
+            vector< vector<InstanceData> > instances_per_model;
+            vector< vector<ObjectId> > objects_per_model;
+            RenderQueue render_queue;
+            //Index of the first instance of every model in the instance buffer
+            vector<GLuint> model_base_instances;
+        };
+
+        map<ObjectId, SceneObject> objects;
+        ObjectId next_object_id = 0;
+        //Ids of removed objects below next_object_id
+        set<ObjectId> free_object_ids;
+        SceneLayer layers[LAYERS_COUNT];
+        size_t static_objects_count = 0;
+
+        //Objects were added or removed, the instance buffer and the draws must be rebuilt
+        bool layout_dirty = true;
+        vector<ObjectId> dirty_objects;
+
+        //GPU state, see SynthRenderer::syncScene. Instances of both layers are in the same buffer
+        const SynthRenderer *renderer = nullptr;
+        GLuint instance_VBO = 0;
+        GLuint geometry_VAOs[VERTEX_FORMATS_COUNT] = {};
+        //Draws point to the meshes of the models, which move when more models are loaded
+        size_t queued_models_count = 0;
+
+        //Image, labels and depth of background and static objects, see SynthRenderer::drawScene
+        GLuint static_layer_framebuffer = 0;
+        vector<GLuint> static_layer_textures;
+        GLuint static_layer_rbo = 0;
+        //False while there is no cached layer yet and whenever a static object changed
+        bool static_layer_valid = false;
+        //Settings the static layer was rendered with
+        SceneSettings static_layer_settings{};
+        //Settings of the last rendered frame, the static layer is not worth rendering while the camera moves. False
+        //until the first frame is rendered
+        bool previous_frame_valid = false;
+        SceneSettings previous_frame_settings{};
+
+        SceneObject& findObject(ObjectId object_id);
+
+public:
+        SceneSettings settings{};
+
+        Scene() = default;
+        ~Scene();
+
+        Scene(const Scene&) = delete;
+        Scene& operator=(const Scene&) = delete;
+
+        //Instance segmentation labels the object with its id plus one. Static objects are cached with the background,
+        //updating or removing them re-renders the cached layer
+        ObjectId addObject(ModelHandle model, const ObjectAttributes &attributes, bool is_static = false);
+
+        void removeObject(ObjectId object_id);
+
+        //Moves the object and/or changes its semantic class
+        void updateObject(ObjectId object_id, const ObjectAttributes &attributes);
+
+        size_t getObjectsCount() const;
+
+        //Ids of the objects in ascending order, which is also the order of their bounding rects
+        vector<ObjectId> getObjectIds() const;
+};
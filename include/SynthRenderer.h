@@ -5,7 +5,7 @@
 #include <assimp/Importer.hpp>
 #include <glad/glad.h> 
 #include <GL/gl.h>
-#include <GLFW/glfw3.h>
+#include <gl_context.h>
 
 
 #include <glm/ext/matrix_transform.hpp>
@@ -14,18 +14,26 @@
 #include <glm/gtc/type_ptr.hpp>
 
 //#include <filesystem.h>
-#include <shader_m.h>
+#include <shader.h>
+#include <uniform_buffer.h>
 #include <camera.h>
 #include <model.h>
+#include <render_queue.h>
+#include <geometry_arena.h>
+#include <host_buffer.h>
 
 #include <algorithm>
+#include <array>
+#include <cstdint>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 #include <optional>
 #include <tuple>
 #include <filesystem>
+#include <functional>
 #include <iostream>
+#include <map>
 
 
 #include <unistd.h>
@@ -37,6 +45,8 @@ using std::vector;
 using std::string;
 using std::unordered_set;
 using std::optional;
+using std::map;
+using std::array;
 using std::clog;
 using std::endl;
 
@@ -44,15 +54,43 @@ using std::endl;
 struct Image
 {
     Image() = default; //Empty image
-    Image(unique_ptr<unsigned char[]>&& data, unsigned int width, unsigned int height, unsigned int channels) : data(std::move(data)), width(width), height(height), channels(channels) {};
+    Image(HostBuffer<unsigned char>&& data, unsigned int width, unsigned int height, unsigned int channels) : data(std::move(data)), width(width), height(height), channels(channels) {};
 
-    unique_ptr<unsigned char[]> data;
+    HostBuffer<unsigned char> data;
     unsigned int width;
     unsigned int height;
     unsigned int channels;
 };
 
 
+//Single channel floating point image (e.g. depth map)
+struct DepthImage
+{
+    DepthImage() = default;
+    DepthImage(HostBuffer<float>&& data, unsigned int width, unsigned int height) : data(std::move(data)), width(width), height(height) {};
+
+    HostBuffer<float> data;
+    unsigned int width;
+    unsigned int height;
+};
+
+
+//Single channel integer image (e.g. segmentation labels)
+struct LabelImage
+{
+    LabelImage() = default;
+    LabelImage(HostBuffer<int32_t>&& data, unsigned int width, unsigned int height) : data(std::move(data)), width(width), height(height) {};
+
+    HostBuffer<int32_t> data;
+    unsigned int width;
+    unsigned int height;
+};
+
+
+//Index of a loaded model, handles are given out by SynthRenderer::loadModels in load order and never change
+typedef int ModelHandle;
+
+
 struct ObjectAttributes
 {
     ObjectAttributes() = default;
@@ -85,7 +123,7 @@ struct Rect {
     glm::vec2 top_right;
 
     Rect() : bottom_left(numeric_limits<float>::max(), numeric_limits<float>::max()),
-        top_right(numeric_limits<float>::min(), numeric_limits<float>::min()) {}
+        top_right(numeric_limits<float>::lowest(), numeric_limits<float>::lowest()) {}
 
 
     void updateBounds(float x, float y)
@@ -98,11 +136,147 @@ struct Rect {
 };
 
 
+//Visible part of an object in the labels of a frame, see SynthRenderer::setLabelStatistics
+struct ObjectLabelStatistics
+{
+    int instance_label;         //Label of the object in the instance segmentation
+    int semantic_class_id;
+    unsigned int pixels_count;  //At the resolution of the labels
+    Rect visible_rect;          //Bounds of the visible pixels in image coordinates, as objects_bounding_rects
+    glm::vec2 centroid;         //Of the visible pixels, in image coordinates
+};
+
+
+struct LabelStatistics
+{
+    vector<ObjectLabelStatistics> objects;  //Visible objects only, in the order of their instance labels
+    map<int, unsigned int> class_pixels_count;
+    unsigned int background_pixels_count = 0;
+};
+
+
 struct SyntheticResult
 {
-    optional<Image> semantic_segmentation;
+    optional<LabelImage> semantic_segmentation;  //Semantic class of the object, zero for background
+    optional<LabelImage> instance_segmentation;  //Index of the object in the scene plus one, zero for background
+    optional<DepthImage> depth;             //Distance from the camera plane, zero for background
     Image image;
-    vector< pair<string, Rect> > object_name_to_bounding_rect;
+    vector< pair<ModelHandle, Rect> > objects_bounding_rects;
+    optional<LabelStatistics> label_statistics;
+};
+
+
+//Background, camera and lights of a scene
+struct SceneSettings
+{
+    int background_image_index = 0;
+
+    glm::vec3 camera_position;
+    glm::vec3 camera_target;
+    glm::vec3 camera_up;
+
+    glm::vec3 sun_light_direction;
+    glm::vec3 sun_light_color;
+    glm::vec3 ambient_light_color;
+    glm::vec3 search_light_color;
+    float search_light_angle = 0.0f;
+};
+
+
+//Everything needed to render one scene: objects, background, camera and lights
+struct SceneSpec : SceneSettings
+{
+    vector< pair<ModelHandle, ObjectAttributes> > objects;
+};
+
+
+//Camera pose of one of the views of a scene, see SynthRenderer::renderViews
+struct CameraView
+{
+    glm::vec3 camera_position;
+    glm::vec3 camera_target;
+    glm::vec3 camera_up;
+};
+
+
+glm::mat4 getModelMatrix(const ObjectAttributes& attributes);
+
+
+class Scene;
+
+
+struct BatchResult
+{
+    unsigned int scenes_count = 0;
+    //Images of all scenes stacked one after another: scenes_count * height * width * channels bytes
+    Image images;
+    vector< vector< pair<ModelHandle, Rect> > > objects_bounding_rects;
+};
+
+
+//std430 layout of the per instance record of the label statistics buffer, see compute_label_statistics.glsl
+struct LabelStatisticsRecord
+{
+    GLuint inverted_min_x;
+    GLuint inverted_min_y;
+    GLuint max_x;
+    GLuint max_y;
+    GLuint pixels_count;
+    GLuint sum_x_low;
+    GLuint sum_x_high;
+    GLuint sum_y_low;
+    GLuint sum_y_high;
+};
+
+
+//Pixel buffer objects one frame is read back into, submitted frames take the slots of the ring in turn
+struct ReadbackSlot
+{
+    GLuint image_pbo = 0;
+    GLuint semantic_segmentation_pbo = 0;
+    GLuint instance_segmentation_pbo = 0;
+    GLuint depth_pbo = 0;
+    GLsync fence = nullptr;
+    long ticket = -1;  //Ticket of the frame in flight, -1 if the slot is free
+    bool has_image = false;
+    bool has_labels = false;
+    //Size of the labels and depth, smaller than the image when rendered at reduced resolution
+    unsigned int labels_width = 0;
+    unsigned int labels_height = 0;
+    vector< pair<ModelHandle, Rect> > objects_bounding_rects;
+    //Label statistics of the frame: reduced on the GPU into the buffer (OpenGL 4.3), from the read back labels otherwise.
+    //Semantic classes of the instance labels, empty if the statistics are not computed
+    bool has_label_statistics = false;
+    GLuint label_statistics_ssbo = 0;
+    GLsizeiptr label_statistics_capacity = 0;  //In records
+    vector<int> instance_classes;
+};
+
+
+//Objects of the renderers which share a context share group (see RendererPool): background images, loaded models with
+//their geometry and materials. Only the renderer which created them loads into them. A context of the share group must
+//be current when the last renderer releases them
+struct SharedRenderResources
+{
+    SharedRenderResources() = default;
+    ~SharedRenderResources();
+
+    SharedRenderResources(const SharedRenderResources&) = delete;
+    SharedRenderResources& operator=(const SharedRenderResources&) = delete;
+
+    vector<GLuint> background_texture_objects;
+    //Textures of meshes without textures, see DefaultTexture
+    DefaultTextureCache default_textures;
+    //Models and their aliases indexed by model handles
+    vector<Model> models;
+    vector<string> model_aliases;
+    unordered_map<string, ModelHandle> model_handles;
+    GeometryArena geometry_arenas[VERTEX_FORMATS_COUNT];
+    //Distinct materials of the meshes of loaded models, MAX_MATERIALS records bound once per context. Meshes refer to
+    //their records by index, identical materials share a record
+    UniformBuffer material_uniform_buffer;
+    vector<MaterialUniforms> materials;
+    map<array<float, 10>, unsigned int> material_indices;
 };
 
 
@@ -117,83 +291,308 @@ class SynthRenderer
             -1.0f,  1.0f, .999f,   0.0f, 1.0f  // Top Left 
         };
 
-        vector<GLuint> background_texture_objects;
+        shared_ptr<SharedRenderResources> resources;
+        //VAOs of this context over the geometry arenas
+        GLuint geometry_VAOs[VERTEX_FORMATS_COUNT] = {};
 
-        unordered_map<string, Model> models;
+        //Per frame instance data of every model indexed by model handles, see drawModels
+        vector< vector<InstanceData> > instances_per_model;
+        //Instances of all the models, uploaded to instance_VBO once per frame
+        vector<InstanceData> frame_instances;
+        GLuint instance_VBO = 0;
+        RenderQueue render_queue;
         unsigned int generate_image_width;
         unsigned int generate_image_height;
-        GLFWwindow* offscreen_window;
+        ContextBackend context_backend;
+        unique_ptr<GLContext> context;
 
         optional<Shader> background_shader; 
         optional<Shader> model_shader;
-        optional<Shader> semantic_segmentation_shader;
+        //Writes labels and depth only, without lighting and textures
+        optional<Shader> labels_shader;
+        //Reduces the instance labels into per object statistics, OpenGL 4.3 only
+        optional<Shader> label_statistics_shader;
        
-        GLuint background_VAO, background_VBO;
+        GLuint background_VAO = 0, background_VBO = 0;
 
-        //Frame buffer objects for synthetic image generation
-        unsigned int framebuffer_object;
-        GLuint generated_image_texture_object;
-        GLuint rbo;
+        //Camera and lights, shared by all the shaders
+        UniformBuffer frame_uniform_buffer;
 
-        //Frame buffer objects for semantic segmentation generation
-        unsigned int semantic_segmentation_framebuffer_object;
-        GLuint semantic_segmentation_texture_object;
-        GLuint semantic_segmentation_rbo;
+        //Frame buffer objects for synthetic image generation, labels are written to extra color attachments in the same pass:
+        //0 - shaded image, 1 - semantic class, 2 - instance, 3 - depth
+        static const unsigned int framebuffer_attachments_count = 4;
+        static constexpr GLenum framebuffer_draw_buffers[framebuffer_attachments_count] = {
+            GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3
+        };
+        //Labels only rendering leaves the image attachment out
+        static constexpr GLenum labels_draw_buffers[framebuffer_attachments_count] = {
+            GL_NONE, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3
+        };
+        unsigned int framebuffer_object = 0;
+        GLuint generated_image_texture_object = 0;
+        GLuint semantic_segmentation_texture_object = 0;
+        GLuint instance_segmentation_texture_object = 0;
+        GLuint depth_texture_object = 0;
+        GLuint rbo = 0;
+
+        //Ring of pixel buffer objects for asynchronous read back
+        static const unsigned int readback_ring_size = 3;
+        vector<ReadbackSlot> readback_slots;
+        long next_readback_ticket = 0;
+        //Whether read back images are allocated in page-locked memory
+        bool page_locked_results = false;
+        //Whether frames rendered with labels come with their label statistics
+        bool label_statistics = false;
+        //Buffers of the results come from the pool and return to it once released, wherever the results went
+        shared_ptr<HostBufferPool> result_buffers_pool = std::make_shared<HostBufferPool>();
+
+        //Frame buffer objects for batched rendering, every scene of a batch goes to its own layer of the array texture
+        unsigned int batch_framebuffer_object = 0;
+        GLuint batch_texture_array_object = 0;
+        GLuint batch_rbo = 0;
+        unsigned int batch_layers_count = 0;
 
 
         void initBackgroundObjects();
 
-        bool initGL();
+        //Creates the context and the GL objects of the renderer. Throws runtime_error with the reason when it can't,
+        //nothing is left created then
+        void initGL(const SynthRenderer *share_resources_with);
+
+        //Shaders, buffers and framebuffers of the renderer, the context must be current
+        void createGLObjects(const SynthRenderer *share_resources_with);
+
+        //Creates the image and label textures and the depth buffer of the size of the images, and attaches them to
+        //the bound framebuffer
+        void createAttachmentTextures(GLuint *texture_objects, GLuint &depth_rbo);
+        //Deletes the objects of this renderer, its context must be current
         void cleanupGL();
 
+        //Deletes the objects of this renderer and the shared ones if it is the last renderer using them, and waits until
+        //the deletions are done. The context must be current
+        void deleteGLObjects();
+
         void drawBackground(int background_index);
 
+        void initBatchObjects(unsigned int scenes_count);
+
+        //Reads all the layers of the batch array texture
+        Image readBatchImages(unsigned int layers_count);
+
+        void initReadbackObjects();
+
+        void initUniformBuffers();
+
+        //Index of the record of the material in the material uniform buffer, the material is added if there is no
+        //identical one yet. Throws if there are more than MAX_MATERIALS distinct materials
+        unsigned int findOrAddMaterial(const MaterialUniforms &material);
+
+        //Uploads the materials added since first_material into the material uniform buffer
+        void updateMaterialUniformBuffer(size_t first_material);
+
+        ReadbackSlot& findReadbackSlot(long ticket);
+
+        //Slot for the next submitted frame, throws if all the slots are busy
+        ReadbackSlot& acquireReadbackSlot();
+
+        //Starts the transfer of the frame in the bound framebuffer into the slot, returns the ticket of the frame. Labels
+        //are read from the corner of the attachments they were rendered to at 1 / labels_downscale of the image size
+        long startReadback(ReadbackSlot &slot, bool generate_image, bool generate_labels, unsigned int labels_downscale = 1);
+
+        //Draws background into currently bound framebuffer and sets up camera and lights for the objects
+        void beginScene(const SceneSettings &settings, glm::mat4 &projection, glm::mat4 &view, bool generate_labels);
+
+        //Starts the reduction of the instance labels of the bound framebuffer into the slot's statistics when they are
+        //enabled, instance_classes are the semantic classes of the instance labels
+        void startLabelStatistics(ReadbackSlot &slot, vector<int> &&instance_classes, unsigned int labels_downscale = 1);
+
+        //Semantic classes of the instance labels of the objects (index plus one), zero for background
+        static vector<int> instanceClasses(const vector< pair<ModelHandle, ObjectAttributes> > &models_to_positions);
+        //Same for the objects of the persistent scene, labeled with their id plus one
+        static vector<int> instanceClasses(const Scene &scene);
+
+        //Per object statistics of the instance labels of the collected frame
+        LabelStatistics collectLabelStatistics(ReadbackSlot &slot, const LabelImage &instance_segmentation) const;
+
+        //Zeroes the label and depth attachments, which must be enabled as draw buffers 1..3
+        void clearLabelAttachments();
+
+        //Sets up the bound framebuffer for drawing labels only, into a viewport reduced by labels_downscale (restored
+        //by startReadback), and camera for the objects
+        void beginLabels(const SceneSettings &settings, glm::mat4 &projection, glm::mat4 &view, unsigned int labels_downscale);
+
+        unsigned int getLabelsWidth(unsigned int labels_downscale) const;
+        unsigned int getLabelsHeight(unsigned int labels_downscale) const;
+
+        //Uploads camera and lights to the frame uniform buffer
+        void updateFrameUniforms(const SceneSettings &settings, glm::mat4 &projection, glm::mat4 &view);
+
+        //Draws background and objects of the scene into currently bound framebuffer, labels go to attachments 1..3
+        void drawScene(const SceneSpec &scene, glm::mat4 &projection, glm::mat4 &view, bool generate_labels = false);
+        void drawScene(Scene &scene, glm::mat4 &projection, glm::mat4 &view, bool generate_labels = false);
+
+        //Brings the GPU copy of the scene's instances up to date, uploading only what changed since the last frame
+        void syncScene(Scene &scene);
+
+        //Renders background and static objects of the scene with all the labels into the scene's static layer
+        void renderStaticLayer(Scene &scene);
+
+        //Bounding rects of the models' convex hulls projected with the matrices of the jobs, in image coordinates.
+        //Objects entirely behind the camera get empty rects (all zeros)
+        vector<Rect> projectBoundingRects(const vector<HullProjectionJob> &jobs) const;
+
         void drawModels(
-                vector< pair<string, ObjectAttributes> > &models_to_positions,
+                const vector< pair<ModelHandle, ObjectAttributes> > &models_to_positions,
+                Shader &shader
+        );
+
+        //Uploads the instances of the objects and collects their draws in render_queue, drawModels submits them
+        void prepareModels(
+                const vector< pair<ModelHandle, ObjectAttributes> > &models_to_positions,
                 Shader &shader
         );
 
+        //Throws for objects with handles of models which are not loaded, before anything of the scene is drawn
+        void checkModelHandles(const vector< pair<ModelHandle, ObjectAttributes> > &models_to_positions) const;
+
 public:
+        //Renderer created with share_resources_with uses background images and models of that renderer, which must be
+        //of the same backend and outlive it. Its context is current on the calling thread after construction. Throws
+        //runtime_error when the context can't be created or doesn't meet the requirements of the renderer
         SynthRenderer(
                 unsigned int generate_image_width, 
-                unsigned int generate_image_height
-                     ) : generate_image_width(generate_image_width), generate_image_height(generate_image_height)
+                unsigned int generate_image_height,
+                ContextBackend context_backend = ContextBackend::GLFW,
+                const SynthRenderer *share_resources_with = nullptr
+                     ) : generate_image_width(generate_image_width), generate_image_height(generate_image_height), context_backend(context_backend)
         {
-            initGL();
+            initGL(share_resources_with);
             //loadModels({{"cube", "models/cube/cube.obj"}});
         };
 
-        ~SynthRenderer()
+        //Deletes the GL objects of the renderer (and of its share group when it is the last renderer using them). Makes
+        //the renderer's context current on the calling thread, so it must not be current on another thread
+        ~SynthRenderer();
+
+        SynthRenderer(const SynthRenderer&) = delete;
+        SynthRenderer& operator=(const SynthRenderer&) = delete;
+
+        unsigned int getImageWidth() const
         {
-            glfwDestroyWindow(this->offscreen_window);
-            glfwTerminate();
-        };
+            return generate_image_width;
+        }
+
+        unsigned int getImageHeight() const
+        {
+            return generate_image_height;
+        }
+
+        //Allocates images of the following results in page-locked memory, which is copied to CUDA devices faster
+        void setPageLockedResults(bool page_locked);
+
+        //Computes per object statistics of the labels of the following frames rendered with labels: visible bounds,
+        //pixel count and centroid of every object and pixel count of every semantic class. Unlike bounding rects they
+        //account for occlusion and the image borders. Reduced on the GPU with OpenGL 4.3, on the CPU otherwise
+        void setLabelStatistics(bool enabled);
+
+        //Moves the context of the renderer between threads, see GLContext
+        void makeContextCurrent();
+        void releaseContext();
 
         int addBackgroundImagesDirectory(const string &background_images_directory);
 
         int getBackgroundImagesCount() const;
 
-        void loadModels(const vector<pair<string, string>> &models_aliases_to_filenames);
+        //Returns handles of the models in the order of the aliases, aliases which are already loaded keep their models.
+        //Convex hulls of the new models are simplified as given, which bounds the cost of their bounding rects
+        vector<ModelHandle> loadModels(const vector<pair<string, string>> &models_aliases_to_filenames,
+                                       const HullSimplification &hull_simplification = HullSimplification());
 
+        //Extent of the models' convex hulls, which is a little larger for simplified hulls
         vector< tuple<string, glm::vec3, glm::vec3> > getModelsExtent() const;
 
-        vector< pair<string, Rect>> computeObjectsBoundingRects(
-            vector< pair<string, ObjectAttributes> > &models_to_positions,
+        //Aliases of the loaded models indexed by model handles
+        const vector<string>& getModelAliases() const;
+
+        //Throws for aliases of models which are not loaded
+        ModelHandle getModelHandle(const string &model_alias) const;
+
+        vector< pair<ModelHandle, Rect>> computeObjectsBoundingRects(
+            const vector< pair<ModelHandle, ObjectAttributes> > &models_to_positions,
             const glm::mat4 &projection_view_matrix
+        ) const;
+
+        //Bounding rects of the objects seen with each of the projection-view matrices
+        vector< vector< pair<ModelHandle, Rect> > > computeObjectsBoundingRects(
+            const vector< pair<ModelHandle, ObjectAttributes> > &models_to_positions,
+            const vector<glm::mat4> &projection_view_matrices
+        ) const;
+
+        //Bounding rects of the objects of the scene in the order of their ids
+        vector< pair<ModelHandle, Rect>> computeObjectsBoundingRects(
+            const Scene &scene,
+            const glm::mat4 &projection_view_matrix
+        ) const;
+
+        //The image is written to image_destination (height * width * 3 bytes) if given, result image has no data then
+        SyntheticResult renderImage(
+                const SceneSpec &scene,
+                bool generate_labels = false,
+                unsigned char *image_destination = nullptr
+        );
+
+        //Starts rendering of the scene, pixels are transferred asynchronously. Returns ticket to collect the frame with
+        long submitImage(
+                const SceneSpec &scene,
+                bool generate_labels = false
         );
 
+        //Same for the persistent scene, which must be rendered by this renderer only. Only the objects which changed since
+        //the scene was rendered last time are uploaded
         SyntheticResult renderImage(
-                vector< pair<string, ObjectAttributes> > &models_to_positions,
-                int background_image_index,
-                glm::vec3 camera_position,
-                glm::vec3 camera_target,
-                glm::vec3 camera_up,
-                glm::vec3 sun_light_direction,
-                glm::vec3 sun_light_color,
-                glm::vec3 ambient_light_color,
-                glm::vec3 search_light_color,
-                float search_light_angle,
-                bool generate_semantic_segmentation = false
+                Scene &scene,
+                bool generate_labels = false,
+                unsigned char *image_destination = nullptr
         );
+
+        long submitImage(
+                Scene &scene,
+                bool generate_labels = false
+        );
+
+        //Renders semantic and instance labels and depth only: no background, lighting or textures. Labels are rendered
+        //at 1 / labels_downscale of the image size, bounding rects stay in full size image coordinates. The result
+        //has no image
+        SyntheticResult renderLabels(const SceneSpec &scene, unsigned int labels_downscale = 1);
+
+        long submitLabels(const SceneSpec &scene, unsigned int labels_downscale = 1);
+
+        //Same for the persistent scene, static objects are drawn with the others
+        SyntheticResult renderLabels(Scene &scene, unsigned int labels_downscale = 1);
+
+        long submitLabels(Scene &scene, unsigned int labels_downscale = 1);
+
+        //Checks (without blocking) whether the submitted frame is transferred
+        bool isImageReady(long ticket);
+
+        //Waits for the submitted frame transfer and returns the frame, image_destination as in renderImage
+        SyntheticResult collectImage(long ticket, unsigned char *image_destination = nullptr);
+
+        //Renders all the scenes and reads them back with a single transfer
+        BatchResult renderBatch(const vector<SceneSpec> &scenes);
+
+        //Renders the persistent scene from every camera view of the trajectory (camera of the scene ends at the last
+        //view), keeping up to readback_ring_size frames in flight. Frames are passed to frame_callback in order as soon
+        //as they are read back. Images go to images_destination (trajectory size * height * width * 3 bytes) if given
+        void renderTrajectory(
+                Scene &scene,
+                const vector<CameraView> &trajectory,
+                bool generate_labels,
+                const std::function<void(size_t, SyntheticResult&)> &frame_callback,
+                unsigned char *images_destination = nullptr);
+
+        //Renders the scene from every camera view (camera of the scene is ignored) and reads the views back with a
+        //single transfer. Objects are uploaded once, only the camera changes between the views
+        BatchResult renderViews(const SceneSpec &scene, const vector<CameraView> &views);
 };
 
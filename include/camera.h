@@ -78,9 +78,8 @@ public:
     }
 
     // returns the view matrix calculated using Euler Angles and the LookAt Matrix
-    glm::mat4 GetViewMatrix()
+    glm::mat4 GetViewMatrix() const
     {
-clog << "glm::lookAt(" << glm::to_string(Position) << ", " << glm::to_string(Position + Front) << ", " << glm::to_string(Up) << ")" << endl;
         return glm::lookAt(Position, Position + Front, Up);
     }
 
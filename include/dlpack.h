@@ -0,0 +1,49 @@
+#ifndef DLPACK_DLPACK_H_
+#define DLPACK_DLPACK_H_
+
+// The subset of the DLPack ABI (https://github.com/dmlc/dlpack, version 0.8) needed to export host tensors.
+// The layouts must match the upstream header, consumers such as torch.from_dlpack read them directly
+
+#include <cstdint>
+
+extern "C" {
+
+typedef enum {
+    kDLCPU = 1,
+} DLDeviceType;
+
+typedef struct {
+    DLDeviceType device_type;
+    int32_t device_id;
+} DLDevice;
+
+typedef enum {
+    kDLInt = 0U,
+    kDLUInt = 1U,
+    kDLFloat = 2U,
+} DLDataTypeCode;
+
+typedef struct {
+    uint8_t code;
+    uint8_t bits;
+    uint16_t lanes;
+} DLDataType;
+
+typedef struct {
+    void *data;
+    DLDevice device;
+    int32_t ndim;
+    DLDataType dtype;
+    int64_t *shape;
+    int64_t *strides;  // in elements, NULL for compact row-major tensors
+    uint64_t byte_offset;
+} DLTensor;
+
+typedef struct DLManagedTensor {
+    DLTensor dl_tensor;
+    void *manager_ctx;
+    void (*deleter)(struct DLManagedTensor *self);
+} DLManagedTensor;
+
+}
+#endif
@@ -0,0 +1,136 @@
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <glad/glad.h>
+
+#include <mesh.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+using namespace std;
+
+// vertices and indices of all the loaded meshes of one vertex format packed into one vertex buffer and one index buffer,
+// so that any of the meshes can be drawn with the same VAO (meshes are told their base vertex and first index).
+// Material index of every vertex is kept in a separate buffer: draws of meshes with different materials can be batched
+// into one multi-draw, and shaders look their material up in the material uniform buffer.
+// Buffers can be shared between contexts, VAOs can't, so every context creates its own VAO with CreateVertexArray
+class GeometryArena
+{
+public:
+    // creates the buffers, they stay empty until the first Upload
+    void Init(VertexFormat format)
+    {
+        this->format = format;
+        stride = format == PACKED_HALF_UV_VERTEX_FORMAT ? sizeof(PackedVertexHalfUV) : sizeof(PackedVertexFloatUV);
+
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glGenBuffers(1, &materialVBO);
+    }
+
+    // sets up a VAO of the current context for the arena, per instance attributes are sourced from the instance buffer
+    unsigned int CreateVertexArray(unsigned int instanceVBO) const
+    {
+        unsigned int VAO;
+        glGenVertexArrays(1, &VAO);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+        // set the vertex attribute pointers, position, normal and tangent are at the same offsets in both formats
+        // vertex Positions
+        glEnableVertexAttribArray(0);	
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(PackedVertexHalfUV, Position));
+        // vertex normals
+        glEnableVertexAttribArray(1);	
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)offsetof(PackedVertexHalfUV, Normal));
+        // vertex texture coords
+        glEnableVertexAttribArray(2);	
+        if (format == PACKED_HALF_UV_VERTEX_FORMAT)
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offsetof(PackedVertexHalfUV, TexCoords));
+        else
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(PackedVertexFloatUV, TexCoords));
+        // vertex tangent with the handedness in w
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)offsetof(PackedVertexHalfUV, Tangent));
+        // material index of the mesh, from its own buffer
+        glBindBuffer(GL_ARRAY_BUFFER, materialVBO);
+        glEnableVertexAttribArray(MATERIAL_INDEX_LOCATION);
+        glVertexAttribIPointer(MATERIAL_INDEX_LOCATION, 1, GL_UNSIGNED_SHORT, sizeof(GLushort), (void*)0);
+
+        // per instance data
+        SetInstanceAttributes(instanceVBO, 0);
+
+        glBindVertexArray(0);
+        return VAO;
+    }
+
+    // packs the mesh geometry and appends it to the arena, it gets to GPU with the next Upload
+    void Add(Mesh &mesh)
+    {
+        if (mesh.GetVertexFormat() != format)
+            throw runtime_error("Mesh vertex format doesn't match the geometry arena");
+
+        mesh.SetArenaPlacement(static_cast<GLint>(vertexData.size() / stride), static_cast<GLuint>(indices.size()));
+
+        size_t offset = vertexData.size();
+        vertexData.resize(offset + mesh.vertices.size() * stride);
+        for (const Vertex &vertex : mesh.vertices)
+        {
+            if (format == PACKED_HALF_UV_VERTEX_FORMAT)
+            {
+                PackedVertexHalfUV packed{vertex.Position, PackNormal(vertex.Normal), PackTangent(vertex), glm::packHalf2x16(vertex.TexCoords)};
+                memcpy(&vertexData[offset], &packed, sizeof(packed));
+            }
+            else
+            {
+                PackedVertexFloatUV packed{vertex.Position, PackNormal(vertex.Normal), PackTangent(vertex), vertex.TexCoords};
+                memcpy(&vertexData[offset], &packed, sizeof(packed));
+            }
+            offset += stride;
+        }
+        indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+        materialIndices.insert(materialIndices.end(), mesh.vertices.size(), static_cast<GLushort>(mesh.GetMaterialIndex()));
+        dirty = true;
+    }
+
+    // uploads the arena if meshes were added since the last upload
+    void Upload()
+    {
+        if (!dirty)
+            return;
+
+        // the element array binding belongs to VAOs, so the indices are uploaded through the copy target
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexData.size(), vertexData.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, materialVBO);
+        glBufferData(GL_ARRAY_BUFFER, materialIndices.size() * sizeof(GLushort), materialIndices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+        glBufferData(GL_COPY_WRITE_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        dirty = false;
+    }
+
+    // deletes the buffers, a context of their share group must be current. VAOs created over them are not deleted
+    void Release()
+    {
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        glDeleteBuffers(1, &materialVBO);
+        VBO = EBO = materialVBO = 0;
+    }
+
+private:
+    unsigned int VBO = 0, EBO = 0, materialVBO = 0;
+    VertexFormat format = PACKED_HALF_UV_VERTEX_FORMAT;
+    GLsizei stride = 0;
+    bool dirty = false;
+
+    // CPU copy of the packed arena, so it can be re-uploaded when more models are loaded
+    vector<unsigned char> vertexData;
+    vector<unsigned int> indices;
+    vector<GLushort> materialIndices;
+};
+#endif
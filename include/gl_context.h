@@ -0,0 +1,41 @@
+#ifndef GL_CONTEXT_H
+#define GL_CONTEXT_H
+
+#include <glad/glad.h>
+
+#include <memory>
+#include <string>
+using namespace std;
+
+// window system the OpenGL context is created with. Only GLFW needs a display, EGL and OSMesa run headless
+// (EGL on a GPU or Mesa llvmpipe, OSMesa always on the CPU)
+enum class ContextBackend {
+    GLFW,
+    EGL,
+    OSMESA
+};
+
+// parses "glfw", "egl" or "osmesa", throws for unknown names and backends the library was built without
+ContextBackend ContextBackendFromName(const string &name);
+
+// OpenGL 4.3 core context (3.3 core if 4.3 is not available). Everything is rendered into framebuffer objects,
+// so the default framebuffer of the context is never used and is as small as the backend allows.
+// A context is current on at most one thread at a time: release it before making it current on another thread
+class GLContext
+{
+public:
+    virtual ~GLContext() = default;
+
+    virtual void MakeCurrent() = 0;
+
+    // detaches the context from the calling thread
+    virtual void ReleaseCurrent() = 0;
+
+    // function loader for glad, valid while the context is current
+    virtual GLADloadproc GetProcAddressFunction() const = 0;
+
+    // returns nullptr if the context can't be created. Contexts created with shareWith (of the same backend) share
+    // buffers, textures and programs with it, container objects (VAOs and framebuffers) are never shared
+    static unique_ptr<GLContext> Create(ContextBackend backend, unsigned int width, unsigned int height, const GLContext *shareWith = nullptr);
+};
+#endif
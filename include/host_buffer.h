@@ -0,0 +1,213 @@
+#ifndef HOST_BUFFER_H
+#define HOST_BUFFER_H
+
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+using namespace std;
+
+// how the memory of a host buffer was allocated
+enum class HostAllocation {
+    HEAP,         // malloc
+    CUDA_PINNED,  // cudaHostAlloc, found at runtime in the CUDA runtime library
+    LOCKED        // page aligned and mlock-ed, when CUDA is not available
+};
+
+class HostBufferPool;
+
+// frees host buffers the way they were allocated, or returns them to the pool they came from
+struct HostBufferDeleter {
+    HostAllocation allocation = HostAllocation::HEAP;
+    size_t bytes = 0;
+    shared_ptr<HostBufferPool> pool;
+
+    void operator()(void *data) const;
+};
+
+// buffer of rendered pixels, optionally in page-locked memory for fast (asynchronous) transfers to a GPU
+template<typename T>
+using HostBuffer = unique_ptr<T[], HostBufferDeleter>;
+
+// cudaHostAlloc and cudaFreeHost of the CUDA runtime, if it can be loaded
+struct CudaHostFunctions {
+    int (*hostAlloc)(void **ptr, size_t size, unsigned int flags) = nullptr;
+    int (*freeHost)(void *ptr) = nullptr;
+
+    static const CudaHostFunctions &Get()
+    {
+        static const CudaHostFunctions functions = load();
+        return functions;
+    }
+
+private:
+    static CudaHostFunctions load()
+    {
+        CudaHostFunctions functions;
+        for (const char *library_name : {"libcudart.so", "libcudart.so.12", "libcudart.so.11.0"})
+        {
+            // the library stays loaded for the lifetime of the process
+            void *library = dlopen(library_name, RTLD_NOW | RTLD_LOCAL);
+            if (library == nullptr)
+                continue;
+            functions.hostAlloc = reinterpret_cast<int (*)(void**, size_t, unsigned int)>(dlsym(library, "cudaHostAlloc"));
+            functions.freeHost = reinterpret_cast<int (*)(void*)>(dlsym(library, "cudaFreeHost"));
+            if (functions.hostAlloc != nullptr && functions.freeHost != nullptr)
+                return functions;
+            functions = CudaHostFunctions();
+        }
+        return functions;
+    }
+};
+
+inline size_t LockedBytes(size_t bytes)
+{
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    return ((bytes + page_size - 1) / page_size) * page_size;
+}
+
+inline void FreeHostMemory(void *data, HostAllocation allocation, size_t bytes)
+{
+    switch (allocation)
+    {
+        case HostAllocation::HEAP:
+            free(data);
+            break;
+        case HostAllocation::CUDA_PINNED:
+            CudaHostFunctions::Get().freeHost(data);
+            break;
+        case HostAllocation::LOCKED:
+            munlock(data, LockedBytes(bytes));
+            free(data);
+            break;
+    }
+}
+
+// allocates bytes of memory, page-locked if asked for: pinned by CUDA when its runtime is available, locked with mlock
+// otherwise. Falls back to ordinary memory when the memory can't be locked (e.g. RLIMIT_MEMLOCK)
+inline void *AllocateHostMemory(size_t bytes, bool pageLocked, HostAllocation &allocation)
+{
+    if (pageLocked)
+    {
+        const CudaHostFunctions &cuda = CudaHostFunctions::Get();
+        void *data = nullptr;
+        if (cuda.hostAlloc != nullptr && cuda.hostAlloc(&data, bytes, 0) == 0)
+        {
+            allocation = HostAllocation::CUDA_PINNED;
+            return data;
+        }
+
+        data = aligned_alloc(sysconf(_SC_PAGESIZE), LockedBytes(bytes));
+        if (data == nullptr)
+            throw bad_alloc();
+        if (mlock(data, LockedBytes(bytes)) == 0)
+        {
+            allocation = HostAllocation::LOCKED;
+            return data;
+        }
+        free(data);
+    }
+
+    // malloc(0) may return null, which would look like no buffer at all
+    void *data = malloc(bytes > 0 ? bytes : 1);
+    if (data == nullptr)
+        throw bad_alloc();
+    allocation = HostAllocation::HEAP;
+    return data;
+}
+
+template<typename T>
+HostBuffer<T> AllocateHostBuffer(size_t count, bool pageLocked = false)
+{
+    HostBufferDeleter deleter;
+    deleter.bytes = count * sizeof(T);
+    void *data = AllocateHostMemory(deleter.bytes, pageLocked, deleter.allocation);
+    return HostBuffer<T>(static_cast<T*>(data), deleter);
+}
+
+// keeps freed buffers for reuse, so that rendering frame after frame of the same size doesn't allocate pixel memory.
+// Buffers acquired from the pool come back to it when they are released, on any thread
+class HostBufferPool : public enable_shared_from_this<HostBufferPool>
+{
+public:
+    explicit HostBufferPool(size_t maxCachedBuffers = 16) : maxCachedBuffers(maxCachedBuffers)
+    {
+    }
+
+    ~HostBufferPool()
+    {
+        for (const CachedBuffer &buffer : cachedBuffers)
+            FreeHostMemory(buffer.data, buffer.allocation, buffer.bytes);
+    }
+
+    template<typename T>
+    HostBuffer<T> Acquire(size_t count, bool pageLocked = false)
+    {
+        HostBufferDeleter deleter;
+        deleter.bytes = count * sizeof(T);
+        deleter.pool = shared_from_this();
+
+        void *data = nullptr;
+        {
+            lock_guard<mutex> lock(cachedBuffersMutex);
+            for (size_t i = 0; i < cachedBuffers.size(); i++)
+            {
+                const CachedBuffer &buffer = cachedBuffers[i];
+                if (buffer.bytes == deleter.bytes && (buffer.allocation != HostAllocation::HEAP) == pageLocked)
+                {
+                    data = buffer.data;
+                    deleter.allocation = buffer.allocation;
+                    cachedBuffers[i] = cachedBuffers.back();
+                    cachedBuffers.pop_back();
+                    break;
+                }
+            }
+        }
+        if (data == nullptr)
+            data = AllocateHostMemory(deleter.bytes, pageLocked, deleter.allocation);
+
+        return HostBuffer<T>(static_cast<T*>(data), std::move(deleter));
+    }
+
+    // takes the buffer back for reuse, frees it if the pool is full
+    void Release(void *data, HostAllocation allocation, size_t bytes)
+    {
+        {
+            lock_guard<mutex> lock(cachedBuffersMutex);
+            if (cachedBuffers.size() < maxCachedBuffers)
+            {
+                cachedBuffers.push_back(CachedBuffer{data, allocation, bytes});
+                return;
+            }
+        }
+        FreeHostMemory(data, allocation, bytes);
+    }
+
+private:
+    struct CachedBuffer {
+        void *data;
+        HostAllocation allocation;
+        size_t bytes;
+    };
+
+    size_t maxCachedBuffers;
+    mutex cachedBuffersMutex;
+    vector<CachedBuffer> cachedBuffers;
+};
+
+inline void HostBufferDeleter::operator()(void *data) const
+{
+    if (data == nullptr)
+        return;
+
+    if (pool)
+        pool->Release(data, allocation, bytes);
+    else
+        FreeHostMemory(data, allocation, bytes);
+}
+#endif
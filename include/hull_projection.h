@@ -0,0 +1,70 @@
+#ifndef HULL_PROJECTION_H
+#define HULL_PROJECTION_H
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+using namespace std;
+
+// points are processed in groups of this many by the SIMD kernels
+#define HULL_POINTS_GROUP_SIZE 8
+
+// convex hull points of a model in structure of arrays layout. The arrays are padded to a multiple of
+// HULL_POINTS_GROUP_SIZE with copies of the last point, which doesn't change the projected bounds
+struct HullPoints {
+    vector<float> x;
+    vector<float> y;
+    vector<float> z;
+    size_t count = 0;  // points without the padding
+
+    static HullPoints FromPoints(const vector<glm::vec3> &points);
+
+    size_t PaddedSize() const
+    {
+        return x.size();
+    }
+};
+
+// bounds of a hull projected into normalized device coordinates. Parts of the hull behind the near plane are
+// clipped away, a hull which is entirely behind it is not visible
+struct ProjectedBounds {
+    float minX;
+    float minY;
+    float maxX;
+    float maxY;
+    bool visible;
+};
+
+// load-time simplification of convex hulls with many vertices, see SimplifyHull
+struct HullSimplification {
+    unsigned int maxVertices = 0;  // 0 keeps the hulls as they are
+    float tolerance = 0.0f;        // accepted growth of the simplified hull about its centroid, relative to its size
+};
+
+// one hull to project with its projection-view-model matrix
+struct HullProjectionJob {
+    const HullPoints *points;
+    glm::mat4 matrix;
+};
+
+// projects the hulls of all the jobs, with AVX2 or SSE kernels when the CPU has them (chosen at runtime once)
+void ProjectHulls(const HullProjectionJob *jobs, size_t count, ProjectedBounds *bounds);
+
+// conservative replacement of a convex hull with at most maxVertices vertices, which encloses all the points. Extreme
+// points of the hull along spread directions are kept and their hull is scaled about its centroid until it encloses the
+// rest. The point count doubles from HULL_POINTS_GROUP_SIZE until the hull grows by at most the tolerance.
+// Hulls which are small enough already are returned as they are. When the extreme points never enclose anything (flat
+// hulls, ties on box-like hulls) the corners of the bounding box, or a tetrahedron around it, are returned instead
+vector<glm::vec3> SimplifyHull(const vector<glm::vec3> &points, const HullSimplification &simplification);
+
+// name of the kernel ProjectHulls uses on this CPU: "avx2", "sse" or "scalar"
+const char *HullProjectionKernelName();
+
+// names of the kernels this CPU can run, the one ProjectHulls chooses first
+vector<const char*> SupportedHullProjectionKernels();
+
+// makes ProjectHulls use the named kernel, returns false when the CPU can't run it. Meant for tests comparing the
+// kernels, must not be called while hulls are projected
+bool SelectHullProjectionKernel(const char *name);
+#endif
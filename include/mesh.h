@@ -5,16 +5,17 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 
 #include <glm/gtx/string_cast.hpp>
 #include <shader.h>
+#include <uniform_buffer.h>
 
 #include <string>
 #include <vector>
 using namespace std;
 
-#define MAX_BONE_INFLUENCE 4
-
+// vertex as loaded from the model file, the GPU gets it in one of the packed formats below
 struct Vertex {
     // position
     glm::vec3 Position;
@@ -26,12 +27,107 @@ struct Vertex {
     glm::vec3 Tangent;
     // bitangent
     glm::vec3 Bitangent;
-    //bone indexes which will influence this vertex
-    int m_BoneIDs[MAX_BONE_INFLUENCE];
-    //weights from each bone
-    float m_Weights[MAX_BONE_INFLUENCE];
 };
 
+// GPU vertex formats: normal and tangent are packed as signed normalized 10-10-10-2 (the 2 bit w of the tangent holds
+// the handedness of the tangent space, the bitangent is reconstructed in the vertex shader)
+enum VertexFormat {
+    PACKED_HALF_UV_VERTEX_FORMAT = 0,   // half float texture coordinates, 24 bytes
+    PACKED_FLOAT_UV_VERTEX_FORMAT,      // float texture coordinates for meshes with tiled UVs beyond half precision, 28 bytes
+    VERTEX_FORMATS_COUNT
+};
+
+struct PackedVertexHalfUV {
+    glm::vec3 Position;
+    GLuint Normal;
+    GLuint Tangent;
+    GLuint TexCoords;
+};
+
+struct PackedVertexFloatUV {
+    glm::vec3 Position;
+    GLuint Normal;
+    GLuint Tangent;
+    glm::vec2 TexCoords;
+};
+
+// largest error of texture coordinates allowed for half precision, a quarter of a texel of 512x512 texture
+#define HALF_TEX_COORDS_TOLERANCE (1.0f / 2048.0f)
+
+// half float texture coordinates are used unless some of them can't be represented precisely enough
+inline VertexFormat SelectVertexFormat(const vector<Vertex> &vertices)
+{
+    for (const Vertex &vertex : vertices)
+    {
+        glm::vec2 roundtrip = glm::unpackHalf2x16(glm::packHalf2x16(vertex.TexCoords));
+        glm::vec2 error = glm::abs(roundtrip - vertex.TexCoords);
+        if (!(error.x <= HALF_TEX_COORDS_TOLERANCE && error.y <= HALF_TEX_COORDS_TOLERANCE))
+            return PACKED_FLOAT_UV_VERTEX_FORMAT;
+    }
+    return PACKED_HALF_UV_VERTEX_FORMAT;
+}
+
+inline GLuint PackNormal(const glm::vec3 &normal)
+{
+    return glm::packSnorm3x10_1x2(glm::vec4(normal, 0.0f));
+}
+
+// packs the tangent with the sign of the bitangent relative to cross(normal, tangent)
+inline GLuint PackTangent(const Vertex &vertex)
+{
+    float handedness = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+    return glm::packSnorm3x10_1x2(glm::vec4(vertex.Tangent, handedness));
+}
+
+//Per object data of instanced rendering, one model is drawn for all its objects at once
+struct InstanceData {
+    glm::mat4 ModelMatrix;
+    GLuint ClassId;
+    GLuint InstanceId;
+};
+
+//Vertex attribute locations of the instance data (model matrix takes four locations)
+#define INSTANCE_MODEL_MATRIX_LOCATION 7
+#define INSTANCE_CLASS_ID_LOCATION 11
+#define INSTANCE_ID_LOCATION 12
+//Vertex attribute location of the material index of the mesh, see GeometryArena
+#define MATERIAL_INDEX_LOCATION 4
+
+// texture units the mesh textures are bound to (first texture of every type)
+enum TextureUnit {
+    DIFFUSE_TEXTURE_UNIT = 0,
+    SPECULAR_TEXTURE_UNIT,
+    NORMAL_TEXTURE_UNIT,
+    HEIGHT_TEXTURE_UNIT,
+    TEXTURE_UNITS_COUNT
+};
+
+// sampler uniform names of the texture units
+static const char * const TEXTURE_UNIT_SAMPLERS[TEXTURE_UNITS_COUNT] = {
+    "texture_diffuse1", "texture_specular1", "texture_normal1", "texture_height1"
+};
+
+// points per instance attributes of the currently bound VAO to the instance buffer, starting at the offset
+inline void SetInstanceAttributes(unsigned int instanceVBO, GLintptr offset)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    // model matrix, column by column
+    for (unsigned int column = 0; column < 4; column++)
+    {
+        glEnableVertexAttribArray(INSTANCE_MODEL_MATRIX_LOCATION + column);
+        glVertexAttribPointer(INSTANCE_MODEL_MATRIX_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                (void*)(offset + offsetof(InstanceData, ModelMatrix) + column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(INSTANCE_MODEL_MATRIX_LOCATION + column, 1);
+    }
+    // class and instance ids
+    glEnableVertexAttribArray(INSTANCE_CLASS_ID_LOCATION);
+    glVertexAttribIPointer(INSTANCE_CLASS_ID_LOCATION, 1, GL_UNSIGNED_INT, sizeof(InstanceData), (void*)(offset + offsetof(InstanceData, ClassId)));
+    glVertexAttribDivisor(INSTANCE_CLASS_ID_LOCATION, 1);
+    glEnableVertexAttribArray(INSTANCE_ID_LOCATION);
+    glVertexAttribIPointer(INSTANCE_ID_LOCATION, 1, GL_UNSIGNED_INT, sizeof(InstanceData), (void*)(offset + offsetof(InstanceData, InstanceId)));
+    glVertexAttribDivisor(INSTANCE_ID_LOCATION, 1);
+}
+
 struct Texture {
     unsigned int id;
     string type;
@@ -59,115 +155,98 @@ class Mesh {
 
         Material material;
 
-        unsigned int VAO;
-
         // constructor
-        Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, Material material)
+        Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, Material material, VertexFormat format)
         {
             this->vertices = vertices;
             this->indices = indices;
             this->textures = textures;
 
             this->material = material;
+            this->format = format;
 
-            // now that we have all the required data, set the vertex buffers and its attribute pointers.
-            setupMesh();
-        }
-
-        // render the mesh
-        void Draw(Shader &shader) 
-        {
-            // bind appropriate textures
-            unsigned int diffuseNr  = 1;
-            unsigned int specularNr = 1;
-            unsigned int normalNr   = 1;
-            unsigned int heightNr   = 1;
-            for(unsigned int i = 0; i < textures.size(); i++)
+            // the shaders sample only the first texture of every type
+            for(unsigned int unit = 0; unit < TEXTURE_UNITS_COUNT; unit++)
+                unitTextures[unit] = 0;
+            for(int i = textures.size() - 1; i >= 0; i--)
             {
-                glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-                                                  // retrieve texture number (the N in diffuse_textureN)
-                string number;
                 string name = textures[i].type;
                 if(name == "texture_diffuse")
-                    number = std::to_string(diffuseNr++);
+                    unitTextures[DIFFUSE_TEXTURE_UNIT] = textures[i].id;
                 else if(name == "texture_specular")
-                    number = std::to_string(specularNr++); // transfer unsigned int to string
+                    unitTextures[SPECULAR_TEXTURE_UNIT] = textures[i].id;
                 else if(name == "texture_normal")
-                    number = std::to_string(normalNr++); // transfer unsigned int to string
+                    unitTextures[NORMAL_TEXTURE_UNIT] = textures[i].id;
                 else if(name == "texture_height")
-                    number = std::to_string(heightNr++); // transfer unsigned int to string
-
-                // now set the sampler to the correct texture unit
-                glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-                // and finally bind the texture
-                glBindTexture(GL_TEXTURE_2D, textures[i].id);
+                    unitTextures[HEIGHT_TEXTURE_UNIT] = textures[i].id;
             }
 
-            //Pass material properties to shader
-            shader.setVec3("Kd", material.Kd);
-            shader.setVec3("Ks", material.Ks);
-            shader.setVec3("Ka", material.Ka);
-            shader.setVec3("Ke", material.Ke);
-            shader.setFloat("Ns", material.Ns);
+            // GPU buffers are shared by all the meshes, see GeometryArena
+        }
 
-            // draw mesh
-            glBindVertexArray(VAO);
-            glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-            glBindVertexArray(0);
+        // material properties in the layout of a MaterialData uniform block record
+        MaterialUniforms GetMaterialUniforms() const
+        {
+            MaterialUniforms uniforms = {};
+            uniforms.Kd = glm::vec4(material.Kd, 1.0f);
+            uniforms.Ks = glm::vec4(material.Ks, 1.0f);
+            uniforms.Ka = glm::vec4(material.Ka, 1.0f);
+            uniforms.Ns = material.Ns;
+            return uniforms;
+        }
 
-            // always good practice to set everything back to defaults once configured.
-            glActiveTexture(GL_TEXTURE0);
+        // state needed to draw the mesh, see RenderQueue
+        const unsigned int* GetUnitTextures() const
+        {
+            return unitTextures;
         }
 
-    private:
-        // render data 
-        unsigned int VBO, EBO;
+        unsigned int GetMaterialIndex() const
+        {
+            return materialIndex;
+        }
 
-        // initializes all the buffer objects/arrays
-        void setupMesh()
+        GLsizei GetIndexCount() const
         {
-            // create buffers/arrays
-            glGenVertexArrays(1, &VAO);
-            glBindVertexArray(VAO);
-
-            glGenBuffers(1, &VBO);
-            glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-            glGenBuffers(1, &EBO);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-
-            // load data into vertex buffers
-            // A great thing about structs is that their memory layout is sequential for all its items.
-            // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-            // again translates to 3/2 floats which translates to a byte array.
-            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
-
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-            // set the vertex attribute pointers
-            // vertex Positions
-            glEnableVertexAttribArray(0);	
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-            // vertex normals
-            glEnableVertexAttribArray(1);	
-            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-            // vertex texture coords
-            glEnableVertexAttribArray(2);	
-            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-            // vertex tangent
-            glEnableVertexAttribArray(3);
-            glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-            // vertex bitangent
-            glEnableVertexAttribArray(4);
-            glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-            // ids
-            glEnableVertexAttribArray(5);
-            glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
-
-            // weights
-            glEnableVertexAttribArray(6);
-            glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
-            glBindVertexArray(0);
+            return static_cast<GLsizei>(indices.size());
         }
+
+        // sets the record of the material uniform buffer holding this mesh's material, before the mesh is added to
+        // its geometry arena
+        void SetMaterialIndex(unsigned int index)
+        {
+            materialIndex = index;
+        }
+
+        // sets where the mesh geometry is placed in the geometry arena of its vertex format
+        void SetArenaPlacement(GLint baseVertex, GLuint firstIndex)
+        {
+            this->baseVertex = baseVertex;
+            this->firstIndex = firstIndex;
+        }
+
+        GLint GetBaseVertex() const
+        {
+            return baseVertex;
+        }
+
+        GLuint GetFirstIndex() const
+        {
+            return firstIndex;
+        }
+
+        VertexFormat GetVertexFormat() const
+        {
+            return format;
+        }
+
+    private:
+        // render data 
+        unsigned int unitTextures[TEXTURE_UNITS_COUNT];
+        unsigned int materialIndex = 0;
+        // placement in the geometry arena (first vertex and first index of the mesh)
+        GLint baseVertex = 0;
+        GLuint firstIndex = 0;
+        VertexFormat format;
 };
 #endif
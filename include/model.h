@@ -15,7 +15,9 @@
 
 #include <quickhull/QuickHull.hpp>
 
+#include <hull_projection.h>
 #include <mesh.h>
+#include <render_queue.h>
 #include <shader.h>
 
 #include <string>
@@ -29,8 +31,11 @@
 #include <algorithm>
 using namespace std;
 
+// 1x1 textures by their color, a cache per share group of contexts since texture names belong to it
+typedef map<unsigned int, unsigned int> DefaultTextureCache;
+
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
-unsigned int DefaultTexture(unsigned char r, unsigned char g, unsigned char b);
+unsigned int DefaultTexture(DefaultTextureCache &defaultTextures, unsigned char r, unsigned char g, unsigned char b);
 pair<glm::vec3, glm::vec3> GenerateTangentAndBitangentForNormal(glm::vec3 normal);
 
 class Model 
@@ -42,26 +47,35 @@ public:
     string directory;
     bool gammaCorrection;
 
-    // Convex hull points (for bounding rectangle calculation optimization)
+    // Convex hull points (for bounding rectangle calculation optimization), possibly simplified into a hull with fewer
+    // points which still encloses the model, see SimplifyHull
     vector<glm::vec3> convexHullPoints;
+    // the same points laid out for the SIMD projection kernels, see ProjectHulls
+    HullPoints convexHullSoA;
 
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    // default textures of meshes without textures come from (and are added to) the cache
+    Model(string const &path, DefaultTextureCache &defaultTextures, bool gamma = false,
+          const HullSimplification &hullSimplification = HullSimplification()) : gammaCorrection(gamma)
     {
-        loadModel(path);
-        ComputeConvexHull();
+        loadModel(path, defaultTextures);
+        ComputeConvexHull(hullSimplification);
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader &shader)
+    // queues one instanced draw per mesh, the instances are the records [baseInstance, baseInstance + instanceCount)
+    // of the shared instance buffer and the draws are issued later by the queue
+    void Enqueue(RenderQueue &queue, const Shader &shader, GLsizei instanceCount, GLuint baseInstance)
     {
+        if (instanceCount == 0)
+            return;
+
         for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+            queue.Push(shader, meshes[i], instanceCount, baseInstance);
     }
     
 private:
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-    void loadModel(string const &path)
+    void loadModel(string const &path, DefaultTextureCache &defaultTextures)
     {
         // read file via ASSIMP
         Assimp::Importer importer;
@@ -84,11 +98,11 @@ private:
         directory = path.substr(0, path.find_last_of('/'));
 
         // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        processNode(scene->mRootNode, scene, defaultTextures);
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    void processNode(aiNode *node, const aiScene *scene, DefaultTextureCache &defaultTextures)
     {
         // process each mesh located at the current node
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
@@ -96,16 +110,16 @@ private:
             // the node object only contains indices to index the actual objects in the scene. 
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            meshes.push_back(processMesh(mesh, scene, defaultTextures));
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, defaultTextures);
         }
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    Mesh processMesh(aiMesh *mesh, const aiScene *scene, DefaultTextureCache &defaultTextures)
     {
         // data to fill
         vector<Vertex> vertices;
@@ -260,10 +274,10 @@ private:
         std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
-        AddDefaultTextures(textures);
+        AddDefaultTextures(textures, defaultTextures);
 
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures, synth_material);
+        // return a mesh object created from the extracted mesh data, packed with the most compact format that keeps its texture coordinates
+        return Mesh(vertices, indices, textures, synth_material, SelectVertexFormat(vertices));
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -301,7 +315,7 @@ private:
         return textures;
     }
 
-    inline void AddDefaultTextures(vector<Texture>& textures)
+    inline void AddDefaultTextures(vector<Texture>& textures, DefaultTextureCache &defaultTextures)
     {
         unordered_set<string> found_texture_types;
         for (auto texture : textures)
@@ -312,7 +326,7 @@ private:
         if (found_texture_types.find("texture_diffuse") == found_texture_types.end())
         {
             Texture texture;
-            texture.id = DefaultTexture(255, 255, 255); 
+            texture.id = DefaultTexture(defaultTextures, 255, 255, 255); 
             texture.type = "texture_diffuse";
             texture.path = "";
             textures.push_back(texture);
@@ -321,7 +335,7 @@ private:
         if (found_texture_types.find("texture_specular") == found_texture_types.end())
         {
             Texture texture;
-            texture.id = DefaultTexture(255, 255, 255); 
+            texture.id = DefaultTexture(defaultTextures, 255, 255, 255); 
             texture.type = "texture_specular";
             texture.path = "";
             textures.push_back(texture);
@@ -330,7 +344,7 @@ private:
         if (found_texture_types.find("texture_normal") == found_texture_types.end())
         {
             Texture texture;
-            texture.id = DefaultTexture(127, 127, 255); 
+            texture.id = DefaultTexture(defaultTextures, 127, 127, 255); 
             texture.type = "texture_normal";
             texture.path = "";
             textures.push_back(texture);
@@ -339,14 +353,14 @@ private:
         if (found_texture_types.find("texture_height") == found_texture_types.end())
         {
             Texture texture;
-            texture.id = DefaultTexture(0, 0, 0); 
+            texture.id = DefaultTexture(defaultTextures, 0, 0, 0); 
             texture.type = "texture_height";
             texture.path = "";
             textures.push_back(texture);
         }
     }
 
-    void ComputeConvexHull()
+    void ComputeConvexHull(const HullSimplification &hullSimplification)
     {
         quickhull::QuickHull<float> qh;
         std::vector<quickhull::Vector3<float>> vertices;
@@ -365,20 +379,28 @@ private:
         auto hull = qh.getConvexHull(vertices, true, false);
         auto convex_hull_vertices = hull.getVertexBuffer();
 
+        vector<glm::vec3> hullPoints;
         for (int i = 0; i < convex_hull_vertices.size(); i++)
         {
-            this->convexHullPoints.push_back(glm::vec3(
+            hullPoints.push_back(glm::vec3(
                         convex_hull_vertices[i].x,
                         convex_hull_vertices[i].y,
                         convex_hull_vertices[i].z));
         }
-
+        this->convexHullPoints = SimplifyHull(hullPoints, hullSimplification);
+        this->convexHullSoA = HullPoints::FromPoints(this->convexHullPoints);
     }
 };
 
 
-inline unsigned int DefaultTexture(unsigned char r, unsigned char g, unsigned char b)
+inline unsigned int DefaultTexture(DefaultTextureCache &defaultTextures, unsigned char r, unsigned char g, unsigned char b)
 {
+    // 1x1 textures of the same color are shared by all the meshes, so meshes without textures end up with the same texture set
+    unsigned int color = (r << 16) | (g << 8) | b;
+    auto default_texture = defaultTextures.find(color);
+    if (default_texture != defaultTextures.end())
+        return default_texture->second;
+
     unsigned int textureID;
     glGenTextures(1, &textureID);
 
@@ -387,6 +409,7 @@ inline unsigned int DefaultTexture(unsigned char r, unsigned char g, unsigned ch
     glBindTexture(GL_TEXTURE_2D, textureID);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
 
+    defaultTextures[color] = textureID;
     return textureID;
 }
 
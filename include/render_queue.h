@@ -0,0 +1,193 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+
+#include <mesh.h>
+#include <shader.h>
+#include <uniform_buffer.h>
+
+#include <algorithm>
+#include <array>
+#include <map>
+#include <tuple>
+#include <vector>
+using namespace std;
+
+// one instanced draw of a mesh, collected from all the models of the frame before submission
+struct DrawItem {
+    const Shader *shader;
+    const Mesh *mesh;
+    unsigned int textureSet;  // meshes bound to the same textures share the texture set index
+    GLsizei instanceCount;
+    GLuint baseInstance;      // first record of the instance buffer used by the draw
+};
+
+// layout of glMultiDrawElementsIndirect commands
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// collects the draws of a frame and submits them sorted by state, skipping redundant state changes
+class RenderQueue
+{
+public:
+    void Clear()
+    {
+        items.clear();
+    }
+
+    void Push(const Shader &shader, const Mesh &mesh, GLsizei instanceCount, GLuint baseInstance)
+    {
+        items.push_back(DrawItem{&shader, &mesh, textureSetIndex(mesh), instanceCount, baseInstance});
+    }
+
+    // multi-draw indirect needs OpenGL 4.3, without it draws of a batch are issued one by one
+    void SetMultiDrawIndirect(bool enabled)
+    {
+        multiDrawIndirect = enabled;
+    }
+
+    // orders the draws by shader, texture set and vertex format, so that consecutive draws share as much state as possible.
+    // Materials are not state: all of them are in one uniform buffer, bound once, and meshes index it themselves
+    void Sort()
+    {
+        std::sort(items.begin(), items.end(), [](const DrawItem &a, const DrawItem &b) {
+            return std::make_tuple(a.shader->ID, a.textureSet, a.mesh->GetVertexFormat()) <
+                   std::make_tuple(b.shader->ID, b.textureSet, b.mesh->GetVertexFormat());
+        });
+    }
+
+    // issues the draws, binding only the state which differs from the previous draw. Consecutive draws with the same
+    // state form a batch, which is submitted with a single glMultiDrawElementsIndirect call when it is available.
+    // Meshes are drawn with the VAO of the current context for their vertex format. With an override shader every draw
+    // uses it instead of its own and no textures are bound (e.g. for drawing labels only)
+    void Submit(const unsigned int (&vertexArrays)[VERTEX_FORMATS_COUNT], unsigned int instanceVBO, const Shader *overrideShader = nullptr)
+    {
+        const bool bindTextures = overrideShader == nullptr;
+        if (multiDrawIndirect && !items.empty())
+        {
+            commands.clear();
+            for (const DrawItem &item : items)
+            {
+                commands.push_back(DrawElementsIndirectCommand{
+                        static_cast<GLuint>(item.mesh->GetIndexCount()),
+                        static_cast<GLuint>(item.instanceCount),
+                        item.mesh->GetFirstIndex(),
+                        item.mesh->GetBaseVertex(),
+                        item.baseInstance});
+            }
+
+            if (indirectBuffer == 0)
+                glGenBuffers(1, &indirectBuffer);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+        }
+
+        const unsigned int UNKNOWN = ~0u;
+        unsigned int currentProgram = UNKNOWN;
+        unsigned int currentTextures[TEXTURE_UNITS_COUNT];
+        std::fill_n(currentTextures, TEXTURE_UNITS_COUNT, UNKNOWN);
+        unsigned int currentVAO = UNKNOWN;
+
+        size_t batchStart = 0;
+        while (batchStart < items.size())
+        {
+            const DrawItem &item = items[batchStart];
+            size_t batchEnd = batchStart + 1;
+            while (batchEnd < items.size() && (bindTextures ? sameState(item, items[batchEnd]) : sameGeometry(item, items[batchEnd])))
+                batchEnd++;
+
+            const Shader *shader = bindTextures ? item.shader : overrideShader;
+            if (shader->ID != currentProgram)
+            {
+                shader->use();
+                currentProgram = shader->ID;
+            }
+
+            const unsigned int *unitTextures = item.mesh->GetUnitTextures();
+            for (unsigned int unit = 0; bindTextures && unit < TEXTURE_UNITS_COUNT; unit++)
+            {
+                if (unitTextures[unit] != currentTextures[unit])
+                {
+                    glActiveTexture(GL_TEXTURE0 + unit);
+                    glBindTexture(GL_TEXTURE_2D, unitTextures[unit]);
+                    currentTextures[unit] = unitTextures[unit];
+                }
+            }
+
+            if (vertexArrays[item.mesh->GetVertexFormat()] != currentVAO)
+            {
+                currentVAO = vertexArrays[item.mesh->GetVertexFormat()];
+                glBindVertexArray(currentVAO);
+            }
+
+            if (multiDrawIndirect)
+            {
+                glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                        (void*)(batchStart * sizeof(DrawElementsIndirectCommand)), static_cast<GLsizei>(batchEnd - batchStart), 0);
+            }
+            else
+            {
+                // no base instance in OpenGL 3.3, instance attributes are re-pointed to the draw's records instead
+                for (size_t i = batchStart; i < batchEnd; i++)
+                {
+                    const DrawItem &batchItem = items[i];
+                    SetInstanceAttributes(instanceVBO, batchItem.baseInstance * sizeof(InstanceData));
+                    glDrawElementsInstancedBaseVertex(GL_TRIANGLES, batchItem.mesh->GetIndexCount(), GL_UNSIGNED_INT,
+                            (void*)(batchItem.mesh->GetFirstIndex() * sizeof(unsigned int)), batchItem.instanceCount, batchItem.mesh->GetBaseVertex());
+                }
+            }
+
+            batchStart = batchEnd;
+        }
+
+        if (multiDrawIndirect)
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    size_t Size() const
+    {
+        return items.size();
+    }
+
+    // deletes the indirect command buffer, the context the queue was submitted in must be current
+    void Release()
+    {
+        if (indirectBuffer != 0)
+            glDeleteBuffers(1, &indirectBuffer);
+        indirectBuffer = 0;
+    }
+
+private:
+    vector<DrawItem> items;
+    map<array<unsigned int, TEXTURE_UNITS_COUNT>, unsigned int> textureSets;
+    bool multiDrawIndirect = false;
+    vector<DrawElementsIndirectCommand> commands;
+    unsigned int indirectBuffer = 0;
+
+    static bool sameState(const DrawItem &a, const DrawItem &b)
+    {
+        return a.shader->ID == b.shader->ID && a.textureSet == b.textureSet && a.mesh->GetVertexFormat() == b.mesh->GetVertexFormat();
+    }
+
+    static bool sameGeometry(const DrawItem &a, const DrawItem &b)
+    {
+        return a.mesh->GetVertexFormat() == b.mesh->GetVertexFormat();
+    }
+
+    unsigned int textureSetIndex(const Mesh &mesh)
+    {
+        array<unsigned int, TEXTURE_UNITS_COUNT> textureSet;
+        std::copy_n(mesh.GetUnitTextures(), TEXTURE_UNITS_COUNT, textureSet.begin());
+        auto inserted = textureSets.emplace(textureSet, static_cast<unsigned int>(textureSets.size()));
+        return inserted.first->second;
+    }
+};
+#endif
@@ -0,0 +1,82 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+// binding points of the uniform blocks shared by the shaders
+#define FRAME_UNIFORM_BLOCK_BINDING 0
+#define MATERIAL_UNIFORM_BLOCK_BINDING 1
+
+// records of the MaterialData uniform block, must match the array size in fragment_light.glsl. The block takes 64 KB,
+// more than the 16 KB OpenGL guarantees: renderers throw when GL_MAX_UNIFORM_BLOCK_SIZE of the context is smaller
+#define MAX_MATERIALS 1024
+
+// std140 layout of the FrameData uniform block: camera and lights, updated once per frame
+struct FrameUniforms {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec4 viewPos;
+    glm::vec4 searchLightPos;
+    glm::vec4 externalLightDir;
+    glm::vec4 searchLightDir;
+    glm::vec4 external_light_color;
+    glm::vec4 searchlight_color;
+    glm::vec4 ambient_light_color;
+    float searchlight_cone_angle_sin;
+    float padding[3];
+};
+
+// std140 layout of a record of the MaterialData uniform block, one record per distinct material. Meshes find their
+// record by the material index of their vertices, see GeometryArena
+struct MaterialUniforms {
+    glm::vec4 Kd;
+    glm::vec4 Ks;
+    glm::vec4 Ka;
+    float Ns;
+    float padding[3];
+};
+
+// thin wrapper around uniform buffer object
+class UniformBuffer
+{
+public:
+    unsigned int ID = 0;
+    GLsizeiptr size = 0;
+
+    // (re)allocates buffer storage, optionally filling it with data
+    void Allocate(GLsizeiptr size, const void *data = nullptr, GLenum usage = GL_DYNAMIC_DRAW)
+    {
+        if (ID == 0)
+            glGenBuffers(1, &ID);
+        this->size = size;
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, size, data, usage);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    // replaces content of the buffer starting at the offset
+    void Update(const void *data, GLsizeiptr size, GLintptr offset = 0)
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    // binds the whole buffer to the uniform block binding point
+    void BindBase(GLuint binding) const
+    {
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, ID);
+    }
+
+    // deletes the buffer, a context of its share group must be current
+    void Release()
+    {
+        glDeleteBuffers(1, &ID);
+        ID = 0;
+        size = 0;
+    }
+};
+#endif
@@ -0,0 +1,60 @@
+#version 430 core
+
+layout (local_size_x = 16, local_size_y = 16) in;
+
+//Instance labels (object index plus one, zero for background) in the corner of the attachment the labels were drawn to
+uniform usampler2D instance_labels;
+uniform int labels_width;
+uniform int labels_height;
+uniform int instances_count;
+
+//Per instance record, see LabelStatisticsRecord. All fields start from zero: minimums are kept inverted
+struct InstanceStatistics {
+    uint inverted_min_x;
+    uint inverted_min_y;
+    uint max_x;
+    uint max_y;
+    uint pixels_count;
+    uint sum_x_low;
+    uint sum_x_high;
+    uint sum_y_low;
+    uint sum_y_high;
+};
+
+layout (std430, binding = 0) buffer LabelStatistics {
+    InstanceStatistics instances[];
+};
+
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (pixel.x >= labels_width || pixel.y >= labels_height)
+    {
+        return;
+    }
+    uint instance = texelFetch(instance_labels, pixel, 0).r;
+    if (instance == 0u || instance >= uint(instances_count))
+    {
+        return;
+    }
+
+    uvec2 position = uvec2(pixel);
+    atomicMax(instances[instance].inverted_min_x, ~position.x);
+    atomicMax(instances[instance].inverted_min_y, ~position.y);
+    atomicMax(instances[instance].max_x, position.x);
+    atomicMax(instances[instance].max_y, position.y);
+    atomicAdd(instances[instance].pixels_count, 1u);
+
+    //Coordinate sums overflow 32 bits for large images, the carry goes to the high word
+    uint previous_x = atomicAdd(instances[instance].sum_x_low, position.x);
+    if (previous_x + position.x < previous_x)
+    {
+        atomicAdd(instances[instance].sum_x_high, 1u);
+    }
+    uint previous_y = atomicAdd(instances[instance].sum_y_low, position.y);
+    if (previous_y + position.y < previous_y)
+    {
+        atomicAdd(instances[instance].sum_y_high, 1u);
+    }
+}
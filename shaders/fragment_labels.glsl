@@ -0,0 +1,18 @@
+#version 330 core
+
+//Labels only, the image attachment is not drawn to
+layout (location = 1) out uint classLabel;
+layout (location = 2) out uint instanceLabel;
+layout (location = 3) out float fragDepth;
+
+in float ViewDepth;
+
+flat in uint class_id;
+flat in uint instance_id;
+
+void main()
+{
+    classLabel = class_id;
+    instanceLabel = instance_id;
+    fragDepth = ViewDepth;
+}
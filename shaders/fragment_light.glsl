@@ -1,6 +1,10 @@
 #version 330 core
 
-out vec3 fragColor;
+layout (location = 0) out vec3 fragColor;
+//Labels, written only when the corresponding color attachments are enabled
+layout (location = 1) out uint classLabel;
+layout (location = 2) out uint instanceLabel;
+layout (location = 3) out float fragDepth;
 
 in VS_OUT {
     vec3 FragPos;
@@ -10,20 +14,40 @@ in VS_OUT {
     vec3 TangentExternalLightDir;
     vec3 TangentViewPos;
     vec3 TangentFragPos;
+    float ViewDepth;
 } fs_in;
 
-//Light properties
-uniform vec3 external_light_color;
-uniform vec3 searchlight_color;
-uniform float searchlight_cone_angle_sin;
-uniform vec3 ambient_light_color;
-
-//Mesh material properties
-uniform vec3 Kd;
-uniform vec3 Ks;
-uniform vec3 Ka;
-uniform vec3 Ke;
-uniform float Ns;
+//Camera and lights, see FrameUniforms
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+    vec4 searchLightPos;
+    vec4 externalLightDir;
+    vec4 searchLightDir;
+    vec4 external_light_color;
+    vec4 searchlight_color;
+    vec4 ambient_light_color;
+    float searchlight_cone_angle_sin;
+};
+
+//Object labels
+flat in uint class_id;
+flat in uint instance_id;
+flat in uint material_index;
+
+//Material properties, see MaterialUniforms
+struct Material {
+    vec4 Kd;
+    vec4 Ks;
+    vec4 Ka;
+    float Ns;
+};
+
+//Distinct materials of all the loaded meshes, MAX_MATERIALS records
+layout (std140) uniform MaterialData {
+    Material materials[1024];
+};
 
 
 //Textures
@@ -33,7 +57,11 @@ uniform sampler2D texture_specular1;
 uniform sampler2D texture_height1;
 
 void main() {
-    float shininess = Ns;
+    Material material = materials[material_index];
+    vec3 Kd = material.Kd.rgb;
+    vec3 Ks = material.Ks.rgb;
+    vec3 Ka = material.Ka.rgb;
+    float shininess = material.Ns;
 
     vec3 normal = vec3(0.0f, 0.0f, 1.0f);  //texture(texture_normal1, fs_in.TexCoords).rgb;
     //normal = normalize(normal * 2.0 - 1.0); // this normal is in tangent space
@@ -41,7 +69,7 @@ void main() {
     //Get the diffuse surface color
     vec3 diffuse_color = Kd * texture(texture_diffuse1, fs_in.TexCoords).rgb;
     // Ambient
-    vec3 ambient = ambient_light_color * Ka;
+    vec3 ambient = ambient_light_color.rgb * Ka;
 
 
     vec3 search_light_vec = fs_in.TangentSearchLightPos - fs_in.TangentFragPos;
@@ -57,7 +85,7 @@ void main() {
                                  * max(dot(normal, search_light_dir), 0.0) / (search_light_dist * search_light_dist);
     float diff_external_light = max(dot(normal, -external_light_dir), 0.0);
 
-    vec3 diffuse = (diff_search_light * searchlight_color + diff_external_light * external_light_color) * diffuse_color;
+    vec3 diffuse = (diff_search_light * searchlight_color.rgb + diff_external_light * external_light_color.rgb) * diffuse_color;
 
     // Specular
     vec3 search_light_halfway_dir = normalize(search_light_dir + view_dir);
@@ -67,9 +95,13 @@ void main() {
     float external_spec = pow(max(dot(normal, external_light_halfway_dir), 0.0), shininess);
 
     vec3 specular = (
-            (1.0 - step(searchlight_cone_angle_sin, search_light_axis_to_frag_sin)) * search_spec * searchlight_color / (search_light_dist * search_light_dist) + 
-            external_spec * external_light_color
+            (1.0 - step(searchlight_cone_angle_sin, search_light_axis_to_frag_sin)) * search_spec * searchlight_color.rgb / (search_light_dist * search_light_dist) + 
+            external_spec * external_light_color.rgb
         ) * Ks * texture(texture_specular1, fs_in.TexCoords).rgb;
 
     fragColor = ambient + diffuse + specular;
+
+    classLabel = class_id;
+    instanceLabel = instance_id;
+    fragDepth = fs_in.ViewDepth;
 }
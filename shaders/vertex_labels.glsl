@@ -0,0 +1,37 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+//Per instance attributes
+layout (location = 7) in mat4 aModel;
+layout (location = 11) in uint aClassId;
+layout (location = 12) in uint aInstanceId;
+
+out float ViewDepth;
+
+flat out uint class_id;
+flat out uint instance_id;
+
+//Camera and lights, see FrameUniforms
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+    vec4 searchLightPos;
+    vec4 externalLightDir;
+    vec4 searchLightDir;
+    vec4 external_light_color;
+    vec4 searchlight_color;
+    vec4 ambient_light_color;
+    float searchlight_cone_angle_sin;
+};
+
+
+void main()
+{
+    class_id = aClassId;
+    instance_id = aInstanceId;
+
+    vec4 view_position = view * aModel * vec4(aPos, 1.0f);
+    ViewDepth = -view_position.z;
+
+    gl_Position = projection * view_position;
+}
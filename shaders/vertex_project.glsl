@@ -2,8 +2,14 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
-layout (location = 3) in vec3 aTangent;
-layout (location = 4) in vec3 aBitangent;
+//Tangent handedness in w, the bitangent is reconstructed from the normal and the tangent
+layout (location = 3) in vec4 aTangent;
+//Record of the mesh's material in MaterialData
+layout (location = 4) in uint aMaterialIndex;
+//Per instance attributes
+layout (location = 7) in mat4 aModel;
+layout (location = 11) in uint aClassId;
+layout (location = 12) in uint aInstanceId;
 
 out VS_OUT {
     vec3 FragPos;
@@ -13,36 +19,54 @@ out VS_OUT {
     vec3 TangentExternalLightDir;
     vec3 TangentViewPos;
     vec3 TangentFragPos;
+    float ViewDepth;
 } vs_out;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+flat out uint class_id;
+flat out uint instance_id;
+flat out uint material_index;
 
-uniform vec3 searchLightPos;
-uniform vec3 viewPos;
-uniform vec3 externalLightDir;
-uniform vec3 searchLightDir;
+//Camera and lights, see FrameUniforms
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+    vec4 searchLightPos;
+    vec4 externalLightDir;
+    vec4 searchLightDir;
+    vec4 external_light_color;
+    vec4 searchlight_color;
+    vec4 ambient_light_color;
+    float searchlight_cone_angle_sin;
+};
 
 
 void main()
 {
+    mat4 model = aModel;
+    class_id = aClassId;
+    instance_id = aInstanceId;
+    material_index = aMaterialIndex;
+
     vs_out.FragPos = vec3(model * vec4(aPos, 1.0));
     vs_out.TexCoords = aTexCoords;
 
     
-    vec3 T = normalize(mat3(model) * aTangent);
+    vec3 T = normalize(mat3(model) * aTangent.xyz);
     vec3 N = normalize(mat3(model) * aNormal);
     T = normalize(T - dot(T, N) * N);
-    vec3 B = cross(N, T);
+    vec3 B = cross(N, T) * (aTangent.w < 0.0 ? -1.0 : 1.0);
 
     mat3 invTBN = transpose(mat3(T, B, N)); //Since TBN is orthogonal, its inverse is its transpose
 
-    vs_out.TangentSearchLightPos = invTBN * searchLightPos;
-    vs_out.TangentSearchLightDir = invTBN * searchLightDir;
-    vs_out.TangentExternalLightDir = invTBN * externalLightDir;
-    vs_out.TangentViewPos = invTBN * viewPos;
+    vs_out.TangentSearchLightPos = invTBN * searchLightPos.xyz;
+    vs_out.TangentSearchLightDir = invTBN * searchLightDir.xyz;
+    vs_out.TangentExternalLightDir = invTBN * externalLightDir.xyz;
+    vs_out.TangentViewPos = invTBN * viewPos.xyz;
     vs_out.TangentFragPos = invTBN * vs_out.FragPos;
 
-    gl_Position = projection * view * model * vec4(aPos, 1.0f);
+    vec4 view_position = view * model * vec4(aPos, 1.0f);
+    vs_out.ViewDepth = -view_position.z;
+
+    gl_Position = projection * view_position;
 }
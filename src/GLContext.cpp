@@ -0,0 +1,372 @@
+#include <gl_context.h>
+
+#include <GLFW/glfw3.h>
+
+#ifdef SYNTH_RENDERER_WITH_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#ifdef SYNTH_RENDERER_WITH_OSMESA
+#include <GL/osmesa.h>
+#endif
+
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+
+using std::clog;
+using std::endl;
+
+//Context versions to try, in order of preference
+static const int CONTEXT_VERSIONS[][2] = {{4, 3}, {3, 3}};
+
+
+ContextBackend ContextBackendFromName(const string &name)
+{
+    if (name == "glfw")
+    {
+        return ContextBackend::GLFW;
+    }
+    if (name == "egl")
+    {
+#ifdef SYNTH_RENDERER_WITH_EGL
+        return ContextBackend::EGL;
+#else
+        throw runtime_error("SynthRenderer was built without the EGL context backend");
+#endif
+    }
+    if (name == "osmesa")
+    {
+#ifdef SYNTH_RENDERER_WITH_OSMESA
+        return ContextBackend::OSMESA;
+#else
+        throw runtime_error("SynthRenderer was built without the OSMesa context backend");
+#endif
+    }
+    throw runtime_error("Unknown context backend: " + name + ", expected one of glfw, egl, osmesa");
+}
+
+
+//Hidden GLFW window, needs X11 or Wayland display
+class GLFWContext : public GLContext
+{
+    //glfwInit and glfwTerminate are process wide, the library stays initialized while any window exists
+    static unsigned int windows_count;
+    GLFWwindow *window = nullptr;
+
+public:
+    GLFWContext(unsigned int width, unsigned int height, const GLFWContext *share_with)
+    {
+        if (windows_count == 0 && !glfwInit())
+        {
+            return;
+        }
+
+        glfwDefaultWindowHints();
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        for (const auto &version : CONTEXT_VERSIONS)
+        {
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, version[0]);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, version[1]);
+            window = glfwCreateWindow(width, height, "", NULL, share_with != nullptr ? share_with->window : NULL);
+            if (window != nullptr)
+            {
+                break;
+            }
+        }
+
+        if (window == nullptr)
+        {
+            clog << "Failed to create GLFW window" << endl;
+            if (windows_count == 0)
+            {
+                glfwTerminate();
+            }
+            return;
+        }
+        windows_count++;
+    }
+
+    ~GLFWContext() override
+    {
+        if (window != nullptr)
+        {
+            glfwDestroyWindow(window);
+            if (--windows_count == 0)
+            {
+                glfwTerminate();
+            }
+        }
+    }
+
+    bool isValid() const
+    {
+        return window != nullptr;
+    }
+
+    void MakeCurrent() override
+    {
+        glfwMakeContextCurrent(window);
+    }
+
+    void ReleaseCurrent() override
+    {
+        glfwMakeContextCurrent(NULL);
+    }
+
+    GLADloadproc GetProcAddressFunction() const override
+    {
+        return (GLADloadproc)glfwGetProcAddress;
+    }
+};
+
+unsigned int GLFWContext::windows_count = 0;
+
+
+#ifdef SYNTH_RENDERER_WITH_EGL
+//EGL context without a window system: Mesa's surfaceless platform when available (works with llvmpipe too), the
+//default display otherwise. The context is made current without a surface if the driver allows it, with a tiny
+//pbuffer otherwise
+class EGLContextBackend : public GLContext
+{
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+    EGLSurface surface = EGL_NO_SURFACE;
+
+    static void *getProcAddress(const char *name)
+    {
+        return (void*)eglGetProcAddress(name);
+    }
+
+    static bool hasExtension(const char *extensions, const char *extension)
+    {
+        if (extensions == nullptr)
+        {
+            return false;
+        }
+        size_t length = strlen(extension);
+        for (const char *found = strstr(extensions, extension); found != nullptr; found = strstr(found + length, extension))
+        {
+            bool starts = found == extensions || found[-1] == ' ';
+            bool ends = found[length] == ' ' || found[length] == '\0';
+            if (starts && ends)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+public:
+    EGLContextBackend(const EGLContextBackend *share_with)
+    {
+        const char *client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        if (hasExtension(client_extensions, "EGL_MESA_platform_surfaceless"))
+        {
+            auto eglGetPlatformDisplayEXT = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+            if (eglGetPlatformDisplayEXT != nullptr)
+            {
+                display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+            }
+        }
+        if (display == EGL_NO_DISPLAY)
+        {
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        }
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+        {
+            clog << "Failed to initialize EGL display" << endl;
+            display = EGL_NO_DISPLAY;
+            return;
+        }
+
+        bool surfaceless = hasExtension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+        const EGLint config_attributes[] = {
+            EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint configs_count = 0;
+        if (!eglChooseConfig(display, config_attributes, &config, 1, &configs_count) || configs_count == 0 || !eglBindAPI(EGL_OPENGL_API))
+        {
+            clog << "No EGL config supports desktop OpenGL" << endl;
+            return;
+        }
+
+        for (const auto &version : CONTEXT_VERSIONS)
+        {
+            const EGLint context_attributes[] = {
+                EGL_CONTEXT_MAJOR_VERSION, version[0],
+                EGL_CONTEXT_MINOR_VERSION, version[1],
+                EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                EGL_NONE
+            };
+            context = eglCreateContext(display, config, share_with != nullptr ? share_with->context : EGL_NO_CONTEXT, context_attributes);
+            if (context != EGL_NO_CONTEXT)
+            {
+                break;
+            }
+        }
+        if (context == EGL_NO_CONTEXT)
+        {
+            clog << "Failed to create EGL context" << endl;
+            return;
+        }
+
+        if (!surfaceless)
+        {
+            const EGLint pbuffer_attributes[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+            surface = eglCreatePbufferSurface(display, config, pbuffer_attributes);
+            if (surface == EGL_NO_SURFACE)
+            {
+                clog << "Failed to create EGL pbuffer" << endl;
+                eglDestroyContext(display, context);
+                context = EGL_NO_CONTEXT;
+            }
+        }
+    }
+
+    ~EGLContextBackend() override
+    {
+        if (display == EGL_NO_DISPLAY)
+        {
+            return;
+        }
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (surface != EGL_NO_SURFACE)
+        {
+            eglDestroySurface(display, surface);
+        }
+        if (context != EGL_NO_CONTEXT)
+        {
+            eglDestroyContext(display, context);
+        }
+        //The display is reference counted by EGL implementations, other renderers of the process may still use it
+    }
+
+    bool isValid() const
+    {
+        return context != EGL_NO_CONTEXT;
+    }
+
+    void MakeCurrent() override
+    {
+        eglMakeCurrent(display, surface, surface, context);
+    }
+
+    void ReleaseCurrent() override
+    {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    }
+
+    GLADloadproc GetProcAddressFunction() const override
+    {
+        return getProcAddress;
+    }
+};
+#endif
+
+
+#ifdef SYNTH_RENDERER_WITH_OSMESA
+//Mesa's off-screen rendering into client memory, CPU only. A 1x1 buffer is enough, nothing is drawn into it
+class OSMesaContextBackend : public GLContext
+{
+    OSMesaContext context = nullptr;
+    unsigned char buffer[4];
+
+    static void *getProcAddress(const char *name)
+    {
+        return (void*)OSMesaGetProcAddress(name);
+    }
+
+public:
+    OSMesaContextBackend(const OSMesaContextBackend *share_with)
+    {
+        for (const auto &version : CONTEXT_VERSIONS)
+        {
+            const int attributes[] = {
+                OSMESA_FORMAT, OSMESA_RGBA,
+                OSMESA_DEPTH_BITS, 0,
+                OSMESA_PROFILE, OSMESA_CORE_PROFILE,
+                OSMESA_CONTEXT_MAJOR_VERSION, version[0],
+                OSMESA_CONTEXT_MINOR_VERSION, version[1],
+                0
+            };
+            context = OSMesaCreateContextAttribs(attributes, share_with != nullptr ? share_with->context : NULL);
+            if (context != nullptr)
+            {
+                break;
+            }
+        }
+        if (context == nullptr)
+        {
+            clog << "Failed to create OSMesa context" << endl;
+        }
+    }
+
+    ~OSMesaContextBackend() override
+    {
+        if (context != nullptr)
+        {
+            OSMesaDestroyContext(context);
+        }
+    }
+
+    bool isValid() const
+    {
+        return context != nullptr;
+    }
+
+    void MakeCurrent() override
+    {
+        OSMesaMakeCurrent(context, buffer, GL_UNSIGNED_BYTE, 1, 1);
+    }
+
+    void ReleaseCurrent() override
+    {
+        OSMesaMakeCurrent(NULL, NULL, 0, 0, 0);
+    }
+
+    GLADloadproc GetProcAddressFunction() const override
+    {
+        return getProcAddress;
+    }
+};
+#endif
+
+
+template<class T, class ...Args>
+static unique_ptr<GLContext> createValid(Args... args)
+{
+    auto context = std::make_unique<T>(args...);
+    if (!context->isValid())
+    {
+        return nullptr;
+    }
+    return context;
+}
+
+
+unique_ptr<GLContext> GLContext::Create(ContextBackend backend, unsigned int width, unsigned int height, const GLContext *shareWith)
+{
+    //Sharing works only within one backend, so the shared context is of the same type
+    switch (backend)
+    {
+        case ContextBackend::GLFW:
+            return createValid<GLFWContext>(width, height, static_cast<const GLFWContext*>(shareWith));
+#ifdef SYNTH_RENDERER_WITH_EGL
+        case ContextBackend::EGL:
+            return createValid<EGLContextBackend>(static_cast<const EGLContextBackend*>(shareWith));
+#endif
+#ifdef SYNTH_RENDERER_WITH_OSMESA
+        case ContextBackend::OSMESA:
+            return createValid<OSMesaContextBackend>(static_cast<const OSMesaContextBackend*>(shareWith));
+#endif
+        default:
+            throw runtime_error("Context backend is not available in this build");
+    }
+}
@@ -0,0 +1,521 @@
+#include <hull_projection.h>
+#include <quickhull/QuickHull.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HULL_PROJECTION_X86
+#endif
+
+
+//Projects the hull with all its points in front of the near plane, returns false (bounds are undefined then) as soon
+//as a point behind it is found
+typedef bool (*FrontProjectionKernel)(const HullPoints &points, const glm::mat4 &matrix, ProjectedBounds &bounds);
+
+
+HullPoints HullPoints::FromPoints(const vector<glm::vec3> &points)
+{
+    HullPoints hull;
+    hull.count = points.size();
+    const size_t padded_size = (points.size() + HULL_POINTS_GROUP_SIZE - 1) / HULL_POINTS_GROUP_SIZE * HULL_POINTS_GROUP_SIZE;
+    hull.x.reserve(padded_size);
+    hull.y.reserve(padded_size);
+    hull.z.reserve(padded_size);
+    for (size_t i = 0; i < padded_size; ++i)
+    {
+        const glm::vec3 &point = points[std::min(i, points.size() - 1)];
+        hull.x.push_back(point.x);
+        hull.y.push_back(point.y);
+        hull.z.push_back(point.z);
+    }
+    return hull;
+}
+
+
+static ProjectedBounds emptyBounds()
+{
+    const float infinity = std::numeric_limits<float>::infinity();
+    return ProjectedBounds{infinity, infinity, -infinity, -infinity, true};
+}
+
+
+static void includePoint(ProjectedBounds &bounds, const glm::vec4 &clip_point)
+{
+    const float x = clip_point.x / clip_point.w;
+    const float y = clip_point.y / clip_point.w;
+    bounds.minX = std::min(bounds.minX, x);
+    bounds.minY = std::min(bounds.minY, y);
+    bounds.maxX = std::max(bounds.maxX, x);
+    bounds.maxY = std::max(bounds.maxY, y);
+}
+
+
+//Clip space points are in front of the near plane when z >= -w
+static bool inFrontOfNearPlane(const glm::vec4 &clip_point)
+{
+    return clip_point.z + clip_point.w >= 0.0f;
+}
+
+
+static bool projectFrontScalar(const HullPoints &points, const glm::mat4 &matrix, ProjectedBounds &bounds)
+{
+    bounds = emptyBounds();
+    for (size_t i = 0; i < points.count; ++i)
+    {
+        const glm::vec4 clip_point = matrix * glm::vec4(points.x[i], points.y[i], points.z[i], 1.0f);
+        if (!inFrontOfNearPlane(clip_point))
+        {
+            return false;
+        }
+        includePoint(bounds, clip_point);
+    }
+    return true;
+}
+
+
+#ifdef HULL_PROJECTION_X86
+static bool projectFrontSSE(const HullPoints &points, const glm::mat4 &matrix, ProjectedBounds &bounds)
+{
+    //Rows of the matrix broadcast to all the lanes, glm matrices are column-major
+    __m128 m[4][4];
+    for (int column = 0; column < 4; ++column)
+    {
+        for (int row = 0; row < 4; ++row)
+        {
+            m[column][row] = _mm_set1_ps(matrix[column][row]);
+        }
+    }
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 min_x = _mm_set1_ps(std::numeric_limits<float>::infinity());
+    __m128 min_y = min_x;
+    __m128 max_x = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+    __m128 max_y = max_x;
+    for (size_t i = 0; i < points.PaddedSize(); i += 4)
+    {
+        const __m128 x = _mm_loadu_ps(points.x.data() + i);
+        const __m128 y = _mm_loadu_ps(points.y.data() + i);
+        const __m128 z = _mm_loadu_ps(points.z.data() + i);
+        __m128 clip[4];
+        for (int row = 0; row < 4; ++row)
+        {
+            clip[row] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0][row], x), _mm_mul_ps(m[1][row], y)),
+                                   _mm_add_ps(_mm_mul_ps(m[2][row], z), m[3][row]));
+        }
+        if (_mm_movemask_ps(_mm_cmpge_ps(_mm_add_ps(clip[2], clip[3]), zero)) != 0xF)
+        {
+            return false;
+        }
+
+        const __m128 inverse_w = _mm_div_ps(one, clip[3]);
+        const __m128 projected_x = _mm_mul_ps(clip[0], inverse_w);
+        const __m128 projected_y = _mm_mul_ps(clip[1], inverse_w);
+        min_x = _mm_min_ps(min_x, projected_x);
+        min_y = _mm_min_ps(min_y, projected_y);
+        max_x = _mm_max_ps(max_x, projected_x);
+        max_y = _mm_max_ps(max_y, projected_y);
+    }
+
+    float lanes[4][4];
+    _mm_storeu_ps(lanes[0], min_x);
+    _mm_storeu_ps(lanes[1], min_y);
+    _mm_storeu_ps(lanes[2], max_x);
+    _mm_storeu_ps(lanes[3], max_y);
+    bounds = ProjectedBounds{
+            *std::min_element(lanes[0], lanes[0] + 4),
+            *std::min_element(lanes[1], lanes[1] + 4),
+            *std::max_element(lanes[2], lanes[2] + 4),
+            *std::max_element(lanes[3], lanes[3] + 4),
+            true};
+    return true;
+}
+
+
+__attribute__((target("avx2,fma")))
+static bool projectFrontAVX2(const HullPoints &points, const glm::mat4 &matrix, ProjectedBounds &bounds)
+{
+    __m256 m[4][4];
+    for (int column = 0; column < 4; ++column)
+    {
+        for (int row = 0; row < 4; ++row)
+        {
+            m[column][row] = _mm256_set1_ps(matrix[column][row]);
+        }
+    }
+
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256 min_x = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+    __m256 min_y = min_x;
+    __m256 max_x = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+    __m256 max_y = max_x;
+    for (size_t i = 0; i < points.PaddedSize(); i += 8)
+    {
+        const __m256 x = _mm256_loadu_ps(points.x.data() + i);
+        const __m256 y = _mm256_loadu_ps(points.y.data() + i);
+        const __m256 z = _mm256_loadu_ps(points.z.data() + i);
+        __m256 clip[4];
+        for (int row = 0; row < 4; ++row)
+        {
+            clip[row] = _mm256_fmadd_ps(m[0][row], x, _mm256_fmadd_ps(m[1][row], y, _mm256_fmadd_ps(m[2][row], z, m[3][row])));
+        }
+        if (_mm256_movemask_ps(_mm256_cmp_ps(_mm256_add_ps(clip[2], clip[3]), zero, _CMP_GE_OQ)) != 0xFF)
+        {
+            return false;
+        }
+
+        const __m256 inverse_w = _mm256_div_ps(one, clip[3]);
+        const __m256 projected_x = _mm256_mul_ps(clip[0], inverse_w);
+        const __m256 projected_y = _mm256_mul_ps(clip[1], inverse_w);
+        min_x = _mm256_min_ps(min_x, projected_x);
+        min_y = _mm256_min_ps(min_y, projected_y);
+        max_x = _mm256_max_ps(max_x, projected_x);
+        max_y = _mm256_max_ps(max_y, projected_y);
+    }
+
+    float lanes[4][8];
+    _mm256_storeu_ps(lanes[0], min_x);
+    _mm256_storeu_ps(lanes[1], min_y);
+    _mm256_storeu_ps(lanes[2], max_x);
+    _mm256_storeu_ps(lanes[3], max_y);
+    bounds = ProjectedBounds{
+            *std::min_element(lanes[0], lanes[0] + 8),
+            *std::min_element(lanes[1], lanes[1] + 8),
+            *std::max_element(lanes[2], lanes[2] + 8),
+            *std::max_element(lanes[3], lanes[3] + 8),
+            true};
+    return true;
+}
+#endif
+
+
+//Hull crossing the near plane: the clipped hull is bounded by its points in front of the plane and by the points where
+//its edges cross the plane. Edges are not kept, so the segments between all the pairs of points on the opposite sides
+//are clipped instead: they lie inside the hull and include the edges, so the bounds are exact
+static ProjectedBounds projectClipped(const HullPoints &points, const glm::mat4 &matrix)
+{
+    vector<glm::vec4> front_points;
+    vector<glm::vec4> behind_points;
+    for (size_t i = 0; i < points.count; ++i)
+    {
+        const glm::vec4 clip_point = matrix * glm::vec4(points.x[i], points.y[i], points.z[i], 1.0f);
+        (inFrontOfNearPlane(clip_point) ? front_points : behind_points).push_back(clip_point);
+    }
+    if (front_points.empty())
+    {
+        return ProjectedBounds{0.0f, 0.0f, 0.0f, 0.0f, false};
+    }
+
+    ProjectedBounds bounds = emptyBounds();
+    for (const glm::vec4 &front_point : front_points)
+    {
+        includePoint(bounds, front_point);
+        const float front_distance = front_point.z + front_point.w;
+        for (const glm::vec4 &behind_point : behind_points)
+        {
+            const float behind_distance = behind_point.z + behind_point.w;
+            const float t = front_distance / (front_distance - behind_distance);
+            includePoint(bounds, front_point + t * (behind_point - front_point));
+        }
+    }
+    return bounds;
+}
+
+
+struct ProjectionKernel
+{
+    const char *name;
+    FrontProjectionKernel function;
+};
+
+
+//Kernels the CPU can run, the fastest first
+static vector<ProjectionKernel> supportedKernels()
+{
+    vector<ProjectionKernel> kernels;
+#ifdef HULL_PROJECTION_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        kernels.push_back(ProjectionKernel{"avx2", projectFrontAVX2});
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        kernels.push_back(ProjectionKernel{"sse", projectFrontSSE});
+    }
+#endif
+    kernels.push_back(ProjectionKernel{"scalar", projectFrontScalar});
+    return kernels;
+}
+
+
+static ProjectionKernel &projectionKernel()
+{
+    static ProjectionKernel kernel = supportedKernels().front();
+    return kernel;
+}
+
+
+void ProjectHulls(const HullProjectionJob *jobs, size_t count, ProjectedBounds *bounds)
+{
+    const FrontProjectionKernel projectFront = projectionKernel().function;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const HullProjectionJob &job = jobs[i];
+        if (job.points->count == 0)
+        {
+            bounds[i] = ProjectedBounds{0.0f, 0.0f, 0.0f, 0.0f, false};
+        }
+        else if (!projectFront(*job.points, job.matrix, bounds[i]))
+        {
+            bounds[i] = projectClipped(*job.points, job.matrix);
+        }
+    }
+}
+
+
+const char *HullProjectionKernelName()
+{
+    return projectionKernel().name;
+}
+
+
+vector<const char*> SupportedHullProjectionKernels()
+{
+    vector<const char*> names;
+    for (const ProjectionKernel &kernel : supportedKernels())
+    {
+        names.push_back(kernel.name);
+    }
+    return names;
+}
+
+
+bool SelectHullProjectionKernel(const char *name)
+{
+    for (const ProjectionKernel &kernel : supportedKernels())
+    {
+        if (std::strcmp(kernel.name, name) == 0)
+        {
+            projectionKernel() = kernel;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+//Axis directions first, so the simplified hull keeps the extent of the model, then directions spread evenly over the
+//sphere (Fibonacci lattice)
+static vector<glm::vec3> supportDirections(size_t count)
+{
+    vector<glm::vec3> directions = {
+            glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+            glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+            glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)};
+    directions.resize(std::min(count, directions.size()));
+
+    const size_t lattice_count = count - directions.size();
+    const float golden_angle = 3.14159265f * (3.0f - std::sqrt(5.0f));
+    for (size_t i = 0; i < lattice_count; ++i)
+    {
+        const float z = 1.0f - (2.0f * i + 1.0f) / lattice_count;
+        const float radius = std::sqrt(std::max(0.0f, 1.0f - z * z));
+        const float angle = golden_angle * i;
+        directions.push_back(glm::vec3(radius * std::cos(angle), radius * std::sin(angle), z));
+    }
+    return directions;
+}
+
+
+//Points furthest along the directions, each point once
+static vector<glm::vec3> supportPoints(const vector<glm::vec3> &points, size_t directions_count)
+{
+    vector<size_t> support_indices;
+    for (const glm::vec3 &direction : supportDirections(directions_count))
+    {
+        size_t best = 0;
+        float best_distance = std::numeric_limits<float>::lowest();
+        for (size_t i = 0; i < points.size(); ++i)
+        {
+            const float distance = glm::dot(points[i], direction);
+            if (distance > best_distance)
+            {
+                best_distance = distance;
+                best = i;
+            }
+        }
+        support_indices.push_back(best);
+    }
+    std::sort(support_indices.begin(), support_indices.end());
+    support_indices.erase(std::unique(support_indices.begin(), support_indices.end()), support_indices.end());
+
+    vector<glm::vec3> support;
+    for (size_t index : support_indices)
+    {
+        support.push_back(points[index]);
+    }
+    return support;
+}
+
+
+//Hull of the reduced points scaled about its centroid so that it encloses all the points: a point is inside when it is
+//behind every face plane, so the scale is the largest ratio of a point's distance to a face's distance from the centroid.
+//Returns false when the reduced hull is flat and no scale can work
+static bool enclosingHull(const vector<glm::vec3> &points, const vector<glm::vec3> &reduced, vector<glm::vec3> &enclosing,
+                          float &scale)
+{
+    if (reduced.size() < 4)
+    {
+        return false;
+    }
+
+    std::vector<quickhull::Vector3<float>> hull_input;
+    for (const glm::vec3 &point : reduced)
+    {
+        hull_input.push_back(quickhull::Vector3<float>(point.x, point.y, point.z));
+    }
+    quickhull::QuickHull<float> qh;
+    auto hull = qh.getConvexHull(hull_input, true, false);
+    const auto &hull_vertices = hull.getVertexBuffer();
+    const auto &hull_indices = hull.getIndexBuffer();
+
+    vector<glm::vec3> vertices;
+    glm::vec3 centroid(0.0f);
+    for (const auto &vertex : hull_vertices)
+    {
+        vertices.push_back(glm::vec3(vertex.x, vertex.y, vertex.z));
+        centroid += vertices.back();
+    }
+    if (vertices.size() < 4)
+    {
+        return false;
+    }
+    centroid /= static_cast<float>(vertices.size());
+
+    float size = 0.0f;
+    for (const glm::vec3 &vertex : vertices)
+    {
+        size = std::max(size, glm::length(vertex - centroid));
+    }
+
+    scale = 1.0f;
+    for (size_t i = 0; i + 2 < hull_indices.size(); i += 3)
+    {
+        const glm::vec3 &a = vertices[hull_indices[i]];
+        glm::vec3 normal = glm::cross(vertices[hull_indices[i + 1]] - a, vertices[hull_indices[i + 2]] - a);
+        const float normal_length = glm::length(normal);
+        if (normal_length == 0.0f)
+        {
+            return false;
+        }
+        normal /= normal_length;
+        float face_distance = glm::dot(normal, a - centroid);
+        if (face_distance < 0.0f)
+        {
+            normal = -normal;
+            face_distance = -face_distance;
+        }
+        if (face_distance <= 1e-6f * size)
+        {
+            return false;
+        }
+
+        for (const glm::vec3 &point : points)
+        {
+            scale = std::max(scale, glm::dot(normal, point - centroid) / face_distance);
+        }
+    }
+    //Slack for the rounding of the scaled vertices
+    scale *= 1.0f + 1e-5f;
+
+    enclosing.clear();
+    for (const glm::vec3 &vertex : vertices)
+    {
+        enclosing.push_back(centroid + scale * (vertex - centroid));
+    }
+    return true;
+}
+
+
+//Used when the extreme points don't enclose anything (flat hulls, or ties of the directions on box-like hulls): corners
+//of the bounding box, or with fewer than 8 vertices allowed a tetrahedron around it. The tetrahedron has a corner of the
+//box as its right angle corner and the legs 3 times the sides of the box, so its slanted face passes the opposite corner
+static vector<glm::vec3> boundingVertices(const vector<glm::vec3> &points, size_t max_vertices)
+{
+    glm::vec3 low = points.front();
+    glm::vec3 high = points.front();
+    for (const glm::vec3 &point : points)
+    {
+        low = glm::vec3(std::min(low.x, point.x), std::min(low.y, point.y), std::min(low.z, point.z));
+        high = glm::vec3(std::max(high.x, point.x), std::max(high.y, point.y), std::max(high.z, point.z));
+    }
+
+    vector<glm::vec3> vertices;
+    if (max_vertices >= 8)
+    {
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            vertices.push_back(glm::vec3((corner & 1) ? high.x : low.x, (corner & 2) ? high.y : low.y, (corner & 4) ? high.z : low.z));
+        }
+    }
+    else
+    {
+        //Slack for the rounding of the slanted face
+        const glm::vec3 legs = 3.0f * (1.0f + 1e-5f) * (high - low);
+        vertices.push_back(low);
+        vertices.push_back(low + glm::vec3(legs.x, 0.0f, 0.0f));
+        vertices.push_back(low + glm::vec3(0.0f, legs.y, 0.0f));
+        vertices.push_back(low + glm::vec3(0.0f, 0.0f, legs.z));
+    }
+
+    //Sides of flat boxes have zero length, their corners repeat
+    vector<glm::vec3> distinct;
+    for (const glm::vec3 &vertex : vertices)
+    {
+        if (std::none_of(distinct.begin(), distinct.end(), [&](const glm::vec3 &other) {
+                return other.x == vertex.x && other.y == vertex.y && other.z == vertex.z; }))
+        {
+            distinct.push_back(vertex);
+        }
+    }
+    return distinct;
+}
+
+
+vector<glm::vec3> SimplifyHull(const vector<glm::vec3> &points, const HullSimplification &simplification)
+{
+    //Fewer than 4 vertices can't enclose anything
+    const size_t max_vertices = std::max<size_t>(simplification.maxVertices, 4);
+    if (simplification.maxVertices == 0 || points.size() <= max_vertices)
+    {
+        return points;
+    }
+
+    vector<glm::vec3> simplified;
+    vector<glm::vec3> enclosing;
+    size_t directions_count = std::min<size_t>(HULL_POINTS_GROUP_SIZE, max_vertices);
+    while (true)
+    {
+        float scale;
+        if (enclosingHull(points, supportPoints(points, directions_count), enclosing, scale))
+        {
+            simplified.swap(enclosing);
+            if (scale <= 1.0f + simplification.tolerance)
+            {
+                break;
+            }
+        }
+        if (directions_count == max_vertices)
+        {
+            break;
+        }
+        directions_count = std::min(directions_count * 2, max_vertices);
+    }
+    return simplified.empty() ? boundingVertices(points, max_vertices) : simplified;
+}
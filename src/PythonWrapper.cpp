@@ -6,11 +6,13 @@
 #include <boost/python/tuple.hpp>
 #include <boost/python/numpy.hpp>
 #include <cstdlib>
+#include <mutex>
 
 #include "SynthRenderer.h"
+#include "RendererPool.h"
+#include "Scene.h"
+#include "dlpack.h"
 
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
 
 
 namespace bp = boost::python;
@@ -27,7 +29,7 @@ const char * const SCALING_KEY = "scale";
 
 
 template<typename T>
-void extractValueFromDict(bp::dict dict, string key, T& value)
+void extractValueFromDict(const bp::dict &dict, const string &key, T& value)
 {
     if (dict.has_key(key))
     {
@@ -40,7 +42,7 @@ void extractValueFromDict(bp::dict dict, string key, T& value)
 }
 
 template<typename T>
-void extractValueFromDictOrDefault(bp::dict dict, string key, T& value, T default_value)
+void extractValueFromDictOrDefault(const bp::dict &dict, const string &key, T& value, T default_value)
 {
     if (dict.has_key(key))
     {
@@ -53,58 +55,979 @@ void extractValueFromDictOrDefault(bp::dict dict, string key, T& value, T defaul
 }
 
 
+glm::vec3 extractVec3(const bp::tuple &vec_tuple)
+{
+    return glm::vec3(
+        bp::extract<float>(vec_tuple[0]),
+        bp::extract<float>(vec_tuple[1]),
+        bp::extract<float>(vec_tuple[2])
+    );
+}
+
+
+//Handles of the loaded models, mirrored on the Python side. Only used with the GIL held, so scenes are parsed without
+//locking the renderer, which may be loading models on another thread
+struct PyModelHandles
+{
+    bp::dict handles;        //alias to handle
+    vector<string> aliases;  //handle to alias
+
+    void add(const vector< pair<string, string> > &models_paths, const vector<ModelHandle> &loaded_handles)
+    {
+        for (size_t i = 0; i < loaded_handles.size(); ++i)
+        {
+            if ((size_t)loaded_handles[i] >= aliases.size())
+            {
+                aliases.resize(loaded_handles[i] + 1);
+            }
+            aliases[loaded_handles[i]] = models_paths[i].first;
+            handles[models_paths[i].first] = loaded_handles[i];
+        }
+    }
+
+    //Model given by its alias or handle
+    ModelHandle find(const bp::object &model) const
+    {
+        bp::extract<string> model_alias(model);
+        if (model_alias.check())
+        {
+            bp::object handle = handles.get(model_alias());
+            if (handle.is_none())
+            {
+                throw std::runtime_error("Unknown model: " + model_alias());
+            }
+            return bp::extract<ModelHandle>(handle);
+        }
+        return check(bp::extract<ModelHandle>(model));
+    }
+
+    ModelHandle check(ModelHandle handle) const
+    {
+        if (handle < 0 || handle >= (ModelHandle)aliases.size())
+        {
+            throw std::runtime_error("Unknown model handle: " + std::to_string(handle));
+        }
+        return handle;
+    }
+};
+
+
+ObjectAttributes extractObjectAttributes(const bp::dict &object_properties_dict)
+{
+    float scaling, x, y, z, yaw, pitch, roll;
+    int semantic_label;
+
+    extractValueFromDict(object_properties_dict, SCALING_KEY, scaling);
+    extractValueFromDict(object_properties_dict, XKEY, x);
+    extractValueFromDict(object_properties_dict, YKEY, y);
+    extractValueFromDict(object_properties_dict, ZKEY, z);
+    extractValueFromDict(object_properties_dict, YAWKEY, yaw);
+    extractValueFromDict(object_properties_dict, PITCHKEY, pitch);
+    extractValueFromDict(object_properties_dict, ROLLKEY, roll);
+    extractValueFromDictOrDefault(object_properties_dict, SEMANTIC_CLASS_KEY, semantic_label, 0);
+
+    return ObjectAttributes(scaling, x, y, z, yaw, pitch, roll, semantic_label);
+}
+
+
+vector< pair<ModelHandle, ObjectAttributes> > extractObjects(const bp::list &models, const PyModelHandles &model_handles)
+{
+    vector< pair<ModelHandle, ObjectAttributes> > models_attributes;
+
+    for (int i = 0; i < bp::len(models); ++i)
+    {
+
+        bp::tuple item = bp::extract<bp::tuple>(models[i]);
+        ModelHandle model_handle = model_handles.find(item[0]);
+        bp::dict object_properties_dict = bp::extract<bp::dict>(item[1]);
+
+        models_attributes.push_back({model_handle, extractObjectAttributes(object_properties_dict)});
+    }
+
+    return models_attributes;
+}
+
+
+//Checks dtype and shape of the array and returns its data, the array must be C-contiguous. Dimensions of the
+//shape given as -1 are not checked
+template<typename T>
+const T *arrayData(const np::ndarray &array, const vector<Py_intptr_t> &shape, const char *name)
+{
+    bool matches = np::equivalent(array.get_dtype(), np::dtype::get_builtin<T>()) &&
+            array.get_nd() == (int)shape.size() && (array.get_flags() & np::ndarray::C_CONTIGUOUS);
+    for (size_t i = 0; matches && i < shape.size(); i++)
+    {
+        matches = shape[i] < 0 || array.shape(i) == shape[i];
+    }
+    if (!matches)
+    {
+        throw std::runtime_error(string(name) + " has wrong dtype or shape, or is not C-contiguous");
+    }
+    return reinterpret_cast<const T*>(array.get_data());
+}
+
+
+//Objects as parallel arrays, N objects: model handles int32 (N,), poses float32 (N, 6) as x, y, z, yaw, pitch, roll,
+//scales float32 (N,), semantic classes int32 (N,)
+vector< pair<ModelHandle, ObjectAttributes> > extractObjectsFromArrays(
+        const PyModelHandles &model_handles_lookup,
+        const np::ndarray &model_handles,
+        const np::ndarray &poses,
+        const np::ndarray &scales,
+        const np::ndarray &semantic_classes)
+{
+    const Py_intptr_t objects_count = model_handles.get_nd() == 1 ? model_handles.shape(0) : 0;
+    const int32_t *handles_data = arrayData<int32_t>(model_handles, {objects_count}, "model_handles");
+    const float *poses_data = arrayData<float>(poses, {objects_count, 6}, "poses");
+    const float *scales_data = arrayData<float>(scales, {objects_count}, "scales");
+    const int32_t *classes_data = arrayData<int32_t>(semantic_classes, {objects_count}, "semantic_classes");
+
+    vector< pair<ModelHandle, ObjectAttributes> > models_attributes;
+    models_attributes.reserve(objects_count);
+    for (Py_intptr_t i = 0; i < objects_count; ++i)
+    {
+        ModelHandle handle = model_handles_lookup.check(handles_data[i]);
+        const float *pose = poses_data + i * 6;
+        models_attributes.push_back({handle, ObjectAttributes(scales_data[i], pose[0], pose[1], pose[2], pose[3], pose[4], pose[5], classes_data[i])});
+    }
+
+    return models_attributes;
+}
+
+
+//Camera views as rows of three float32 (N, 3) arrays
+vector<CameraView> extractCameraViews(const np::ndarray &camera_positions, const np::ndarray &camera_targets, const np::ndarray &camera_ups)
+{
+    const Py_intptr_t views_count = camera_positions.get_nd() == 2 ? camera_positions.shape(0) : 0;
+    const float *positions_data = arrayData<float>(camera_positions, {views_count, 3}, "camera_positions");
+    const float *targets_data = arrayData<float>(camera_targets, {views_count, 3}, "camera_targets");
+    const float *ups_data = arrayData<float>(camera_ups, {views_count, 3}, "camera_ups");
+
+    vector<CameraView> views(views_count);
+    for (Py_intptr_t i = 0; i < views_count; ++i)
+    {
+        views[i].camera_position = glm::vec3(positions_data[i * 3], positions_data[i * 3 + 1], positions_data[i * 3 + 2]);
+        views[i].camera_target = glm::vec3(targets_data[i * 3], targets_data[i * 3 + 1], targets_data[i * 3 + 2]);
+        views[i].camera_up = glm::vec3(ups_data[i * 3], ups_data[i * 3 + 1], ups_data[i * 3 + 2]);
+    }
+    return views;
+}
+
+
+//Background, camera and lights of the scene
+SceneSettings extractSceneSettings(
+        int background_image_index,
+        const bp::tuple &camera_position,
+        const bp::tuple &camera_target,
+        const bp::tuple &camera_up,
+        const bp::tuple &sun_light_direction,
+        const bp::tuple &sun_light_color,
+        const bp::tuple &ambient_light_color,
+        const bp::tuple &search_light_color,
+        double search_light_angle)
+{
+    SceneSettings scene;
+    scene.background_image_index = background_image_index;
+    scene.camera_position = extractVec3(camera_position);
+    scene.camera_target = extractVec3(camera_target);
+    scene.camera_up = extractVec3(camera_up);
+    scene.sun_light_direction = extractVec3(sun_light_direction);
+    scene.sun_light_color = extractVec3(sun_light_color);
+    scene.ambient_light_color = extractVec3(ambient_light_color);
+    scene.search_light_color = extractVec3(search_light_color);
+    scene.search_light_angle = search_light_angle;
+    return scene;
+}
+
+
+SceneSpec extractScene(
+        int background_image_index,
+        const bp::tuple &camera_position,
+        const bp::tuple &camera_target,
+        const bp::tuple &camera_up,
+        const bp::tuple &sun_light_direction,
+        const bp::tuple &sun_light_color,
+        const bp::tuple &ambient_light_color,
+        const bp::tuple &search_light_color,
+        double search_light_angle,
+        const bp::list &models,
+        const PyModelHandles &model_handles)
+{
+    //Extract objects, camera and light positions from python objects
+    SceneSettings settings = extractSceneSettings(
+            background_image_index,
+            camera_position,
+            camera_target,
+            camera_up,
+            sun_light_direction,
+            sun_light_color,
+            ambient_light_color,
+            search_light_color,
+            search_light_angle);
+    return SceneSpec{settings, extractObjects(models, model_handles)};
+}
+
+
+bp::list boundingRectsToList(const vector< pair<ModelHandle, Rect> > &bounding_rects, const vector<string> &model_aliases)
+{
+    bp::list objects_bounding_rects = bp::list();
+    for (auto& object_bounding_rect : bounding_rects)
+    {
+        bp::tuple object_bounding_rect_tuple = bp::make_tuple(
+                model_aliases[object_bounding_rect.first], //object name
+                object_bounding_rect.second.top_right.y,  //top
+                object_bounding_rect.second.bottom_left.x, //left
+                object_bounding_rect.second.bottom_left.y, //bottom 
+                object_bounding_rect.second.top_right.x //right
+        );
+
+        objects_bounding_rects.append(object_bounding_rect_tuple);
+    }
+
+    return objects_bounding_rects;
+}
+
+
+//Python type of the returned images: numpy arrays or DLPack capsules (e.g. for torch.from_dlpack), both without copying
+enum class OutputFormat
+{
+    NUMPY,
+    DLPACK
+};
+
+
+OutputFormat outputFormatFromName(const string &name)
+{
+    if (name == "numpy")
+    {
+        return OutputFormat::NUMPY;
+    }
+    if (name == "dlpack")
+    {
+        return OutputFormat::DLPACK;
+    }
+    throw std::runtime_error("Unknown output format: " + name + ", expected numpy or dlpack");
+}
+
+
+template<typename T>
+void deleteCapsuleBuffer(PyObject *capsule)
+{
+    delete static_cast<HostBuffer<T>*>(PyCapsule_GetPointer(capsule, nullptr));
+}
+
+
+//Row-major strides of the shape, in elements
+vector<Py_intptr_t> contiguousStrides(const vector<Py_intptr_t> &shape)
+{
+    vector<Py_intptr_t> strides(shape.size());
+    Py_intptr_t stride = 1;
+    for (size_t i = shape.size(); i-- > 0;)
+    {
+        strides[i] = stride;
+        stride *= shape[i];
+    }
+    return strides;
+}
+
+
+//Wraps the buffer into a C-contiguous numpy array without copying. The array takes the buffer over, it is freed
+//by the capsule owning it once Python releases the array
+template<typename T>
+np::ndarray adoptAsArray(HostBuffer<T> &&data, const vector<Py_intptr_t> &shape)
+{
+    vector<Py_intptr_t> strides = contiguousStrides(shape);
+    for (auto &stride : strides)
+    {
+        stride *= sizeof(T);
+    }
+
+    auto owned_data = std::make_unique<HostBuffer<T>>(std::move(data));
+    T *raw_data = owned_data->get();
+    bp::object owner(bp::handle<>(PyCapsule_New(owned_data.get(), nullptr, deleteCapsuleBuffer<T>)));
+    owned_data.release();
+    return np::from_data(raw_data, np::dtype::get_builtin<T>(), shape, strides, owner);
+}
+
+
+template<typename T> DLDataType dlpackDataType();
+template<> DLDataType dlpackDataType<unsigned char>() { return DLDataType{kDLUInt, 8, 1}; }
+template<> DLDataType dlpackDataType<float>() { return DLDataType{kDLFloat, 32, 1}; }
+template<> DLDataType dlpackDataType<int32_t>() { return DLDataType{kDLInt, 32, 1}; }
+
+
+//Owner of the exported buffer, freed by the consumer of the tensor through the deleter
+template<typename T>
+struct DLPackExport
+{
+    HostBuffer<T> data;
+    vector<int64_t> shape;
+    DLManagedTensor managed_tensor;
+};
+
+
+template<typename T>
+void deleteDLPackExport(DLManagedTensor *self)
+{
+    delete static_cast<DLPackExport<T>*>(self->manager_ctx);
+}
+
+
+//Consumers rename the capsule to "used_dltensor" when they take the tensor over, otherwise it is still ours to free
+void deleteDLPackCapsule(PyObject *capsule)
+{
+    if (PyCapsule_IsValid(capsule, "dltensor"))
+    {
+        DLManagedTensor *managed_tensor = static_cast<DLManagedTensor*>(PyCapsule_GetPointer(capsule, "dltensor"));
+        managed_tensor->deleter(managed_tensor);
+    }
+}
+
+
+//Wraps the buffer into a "dltensor" capsule without copying, the tensor takes the buffer over
+template<typename T>
+bp::object adoptAsDLPack(HostBuffer<T> &&data, const vector<Py_intptr_t> &shape)
+{
+    auto exported = std::make_unique<DLPackExport<T>>();
+    exported->data = std::move(data);
+    exported->shape.assign(shape.begin(), shape.end());
+
+    DLTensor &tensor = exported->managed_tensor.dl_tensor;
+    tensor.data = exported->data.get();
+    tensor.device = DLDevice{kDLCPU, 0};
+    tensor.ndim = static_cast<int32_t>(shape.size());
+    tensor.dtype = dlpackDataType<T>();
+    tensor.shape = exported->shape.data();
+    tensor.strides = nullptr;
+    tensor.byte_offset = 0;
+    exported->managed_tensor.manager_ctx = exported.get();
+    exported->managed_tensor.deleter = deleteDLPackExport<T>;
+
+    bp::object capsule(bp::handle<>(PyCapsule_New(&exported->managed_tensor, "dltensor", deleteDLPackCapsule)));
+    exported.release();
+    return capsule;
+}
+
+
+template<typename T>
+bp::object adoptAs(OutputFormat output_format, HostBuffer<T> &&data, const vector<Py_intptr_t> &shape)
+{
+    if (output_format == OutputFormat::DLPACK)
+    {
+        return adoptAsDLPack(std::move(data), shape);
+    }
+    return adoptAsArray(std::move(data), shape);
+}
+
+
+//Checks that the renderer can write the image right into the array: writable C-contiguous uint8 (height, width, 3)
+unsigned char *outputArrayData(const bp::object &out, unsigned int width, unsigned int height)
+{
+    bp::extract<np::ndarray> array_extract(out);
+    if (!array_extract.check())
+    {
+        throw std::runtime_error("out must be a numpy array");
+    }
+    np::ndarray array = array_extract();
+    if (!np::equivalent(array.get_dtype(), np::dtype::get_builtin<unsigned char>()) ||
+            array.get_nd() != 3 || array.shape(0) != (Py_intptr_t)height || array.shape(1) != (Py_intptr_t)width || array.shape(2) != 3 ||
+            !(array.get_flags() & np::ndarray::C_CONTIGUOUS) || !(array.get_flags() & np::ndarray::WRITEABLE))
+    {
+        throw std::runtime_error("out must be a writable C-contiguous uint8 array of shape (" +
+                std::to_string(height) + ", " + std::to_string(width) + ", 3)");
+    }
+    return reinterpret_cast<unsigned char*>(array.get_data());
+}
+
+
+//Images of a rendering result as Python objects, None for the labels which were not rendered
+struct ResultImages
+{
+    bp::object image;
+    bp::object semantic_segmentation;
+    bp::object instance_segmentation;
+    bp::object depth;
+};
+
+
+//image_out is the caller's array the image was rendered into, None if the result owns the image. Image is None if
+//only labels were rendered
+ResultImages adoptResultImages(SyntheticResult &rendering_results, OutputFormat output_format, const bp::object &image_out)
+{
+    //Returned arrays adopt the read back buffers
+    const vector<Py_intptr_t> image_shape = {rendering_results.image.height, rendering_results.image.width, 3};
+    bp::object image_result;
+    if (!image_out.is_none())
+    {
+        image_result = image_out;
+    }
+    else if (rendering_results.image.data)
+    {
+        image_result = adoptAs(output_format, std::move(rendering_results.image.data), image_shape);
+    }
+
+    //Labels and depth are single channel (H, W) arrays, smaller than the image when rendered at reduced resolution
+    bp::object semantic_segmentation_result_object;
+    if (rendering_results.semantic_segmentation.has_value())
+    {
+        LabelImage &labels = rendering_results.semantic_segmentation.value();
+        semantic_segmentation_result_object = adoptAs(output_format, std::move(labels.data), {labels.height, labels.width});
+    }
+
+    bp::object instance_segmentation_result_object;
+    if (rendering_results.instance_segmentation.has_value())
+    {
+        LabelImage &labels = rendering_results.instance_segmentation.value();
+        instance_segmentation_result_object = adoptAs(output_format, std::move(labels.data), {labels.height, labels.width});
+    }
+
+    bp::object depth_result_object;
+    if (rendering_results.depth.has_value())
+    {
+        DepthImage &depth = rendering_results.depth.value();
+        depth_result_object = adoptAs(output_format, std::move(depth.data), {depth.height, depth.width});
+    }
+
+    return ResultImages{image_result, semantic_segmentation_result_object, instance_segmentation_result_object, depth_result_object};
+}
+
+
+//Label statistics as a dict of arrays with a row per visible object: instance_labels, semantic_classes and
+//pixels_counts (int32 (N,)), boxes (float32 (N, 4) of top, left, bottom, right) and centroids (float32 (N, 2) of x, y),
+//with class_pixels_counts dict of semantic class to pixels count and background_pixels_count
+bp::dict labelStatisticsToDict(const LabelStatistics &statistics)
+{
+    const size_t objects_count = statistics.objects.size();
+    HostBuffer<int32_t> instance_labels = AllocateHostBuffer<int32_t>(std::max<size_t>(objects_count, 1));
+    HostBuffer<int32_t> semantic_classes = AllocateHostBuffer<int32_t>(std::max<size_t>(objects_count, 1));
+    HostBuffer<int32_t> pixels_counts = AllocateHostBuffer<int32_t>(std::max<size_t>(objects_count, 1));
+    HostBuffer<float> boxes = AllocateHostBuffer<float>(std::max<size_t>(objects_count, 1) * 4);
+    HostBuffer<float> centroids = AllocateHostBuffer<float>(std::max<size_t>(objects_count, 1) * 2);
+    for (size_t i = 0; i < objects_count; ++i)
+    {
+        const ObjectLabelStatistics &object = statistics.objects[i];
+        instance_labels[i] = object.instance_label;
+        semantic_classes[i] = object.semantic_class_id;
+        pixels_counts[i] = object.pixels_count;
+        float *box = boxes.get() + i * 4;
+        box[0] = object.visible_rect.top_right.y;      //top
+        box[1] = object.visible_rect.bottom_left.x;    //left
+        box[2] = object.visible_rect.bottom_left.y;    //bottom
+        box[3] = object.visible_rect.top_right.x;      //right
+        centroids[i * 2] = object.centroid.x;
+        centroids[i * 2 + 1] = object.centroid.y;
+    }
+
+    bp::dict class_pixels_counts;
+    for (const auto &class_pixels : statistics.class_pixels_count)
+    {
+        class_pixels_counts[class_pixels.first] = class_pixels.second;
+    }
+
+    bp::dict statistics_dict;
+    statistics_dict["instance_labels"] = adoptAsArray(std::move(instance_labels), {(Py_intptr_t)objects_count});
+    statistics_dict["semantic_classes"] = adoptAsArray(std::move(semantic_classes), {(Py_intptr_t)objects_count});
+    statistics_dict["pixels_counts"] = adoptAsArray(std::move(pixels_counts), {(Py_intptr_t)objects_count});
+    statistics_dict["boxes"] = adoptAsArray(std::move(boxes), {(Py_intptr_t)objects_count, 4});
+    statistics_dict["centroids"] = adoptAsArray(std::move(centroids), {(Py_intptr_t)objects_count, 2});
+    statistics_dict["class_pixels_counts"] = class_pixels_counts;
+    statistics_dict["background_pixels_count"] = statistics.background_pixels_count;
+    return statistics_dict;
+}
+
+
+//Label statistics of the result as a dict, None when the renderer doesn't compute them or the result has no labels
+bp::object labelStatisticsOrNone(const SyntheticResult &rendering_results)
+{
+    if (!rendering_results.label_statistics.has_value())
+    {
+        return bp::object();
+    }
+    return labelStatisticsToDict(rendering_results.label_statistics.value());
+}
+
+
+//Label statistics are always the last item of the result tuple, so its length doesn't depend on set_label_statistics
+bp::tuple appendLabelStatistics(const bp::tuple &result, const SyntheticResult &rendering_results)
+{
+    return bp::tuple(result + bp::make_tuple(labelStatisticsOrNone(rendering_results)));
+}
+
+
+bp::tuple syntheticResultToTuple(
+        SyntheticResult &rendering_results,
+        const vector<string> &model_aliases,
+        OutputFormat output_format = OutputFormat::NUMPY,
+        bp::object image_out = bp::object())
+{
+    ResultImages images = adoptResultImages(rendering_results, output_format, image_out);
+
+    //Extract objects bounding boxes and convert them into python list
+    bp::list objects_bounding_rects = boundingRectsToList(rendering_results.objects_bounding_rects, model_aliases);
+
+    bp::tuple result = bp::make_tuple(
+            images.image,
+            objects_bounding_rects,
+            images.semantic_segmentation,
+            images.instance_segmentation,
+            images.depth);
+    return appendLabelStatistics(result, rendering_results);
+}
+
+
+//Result of labels only rendering: bounding rects, semantic and instance labels and depth
+bp::tuple labelsResultToTuple(SyntheticResult &rendering_results, const vector<string> &model_aliases, OutputFormat output_format)
+{
+    ResultImages images = adoptResultImages(rendering_results, output_format, bp::object());
+    bp::tuple result = bp::make_tuple(
+            boundingRectsToList(rendering_results.objects_bounding_rects, model_aliases),
+            images.semantic_segmentation,
+            images.instance_segmentation,
+            images.depth);
+    return appendLabelStatistics(result, rendering_results);
+}
+
+
+//Same as syntheticResultToTuple, bounding boxes as a float32 (N, 4) array of top, left, bottom, right rows in the order
+//of the objects, followed by the int32 model handles of the rows
+bp::tuple syntheticResultToArraysTuple(
+        SyntheticResult &rendering_results,
+        OutputFormat output_format = OutputFormat::NUMPY,
+        bp::object image_out = bp::object())
+{
+    ResultImages images = adoptResultImages(rendering_results, output_format, image_out);
+
+    const vector< pair<ModelHandle, Rect> > &bounding_rects = rendering_results.objects_bounding_rects;
+    HostBuffer<float> boxes = AllocateHostBuffer<float>(std::max<size_t>(bounding_rects.size(), 1) * 4);
+    HostBuffer<int32_t> handles = AllocateHostBuffer<int32_t>(std::max<size_t>(bounding_rects.size(), 1));
+    for (size_t i = 0; i < bounding_rects.size(); ++i)
+    {
+        handles[i] = bounding_rects[i].first;
+        const Rect &rect = bounding_rects[i].second;
+        float *box = boxes.get() + i * 4;
+        box[0] = rect.top_right.y;      //top
+        box[1] = rect.bottom_left.x;    //left
+        box[2] = rect.bottom_left.y;    //bottom
+        box[3] = rect.top_right.x;      //right
+    }
+    np::ndarray boxes_result = adoptAsArray(std::move(boxes), {(Py_intptr_t)bounding_rects.size(), 4});
+    np::ndarray handles_result = adoptAsArray(std::move(handles), {(Py_intptr_t)bounding_rects.size()});
+
+    bp::tuple result = bp::make_tuple(
+            images.image,
+            boxes_result,
+            handles_result,
+            images.semantic_segmentation,
+            images.instance_segmentation,
+            images.depth);
+    return appendLabelStatistics(result, rendering_results);
+}
+
+
+//Images of a batch as an (N, H, W, 3) array and a list of the bounding rects lists of the images
+bp::tuple batchResultToTuple(BatchResult &batch_results, const vector<string> &model_aliases, OutputFormat output_format)
+{
+    //Array of shape (N, H, W, 3) adopts the images of all the scenes
+    if (!batch_results.images.data)
+    {
+        batch_results.images.data = AllocateHostBuffer<unsigned char>(0);
+    }
+    bp::object images_result = adoptAs(output_format, std::move(batch_results.images.data),
+            {batch_results.scenes_count, batch_results.images.height, batch_results.images.width, 3});
+
+    bp::list scenes_bounding_rects = bp::list();
+    for (auto& bounding_rects : batch_results.objects_bounding_rects)
+    {
+        scenes_bounding_rects.append(boundingRectsToList(bounding_rects, model_aliases));
+    }
+
+    return bp::make_tuple(images_result, scenes_bounding_rects);
+}
+
+
+//Releases the GIL for the lifetime of the object, so other Python threads run while the renderer works
+class ScopedGILRelease
+{
+    PyThreadState *thread_state;
+public:
+    ScopedGILRelease() : thread_state(PyEval_SaveThread())
+    {
+    }
+
+    ~ScopedGILRelease()
+    {
+        PyEval_RestoreThread(thread_state);
+    }
+
+    ScopedGILRelease(const ScopedGILRelease&) = delete;
+    ScopedGILRelease& operator=(const ScopedGILRelease&) = delete;
+};
+
+
+//Makes the context of the renderer (or of the pool's primary renderer) current on the calling thread for the lifetime
+//of the object. Any Python thread may call the renderer (e.g. data loader workers), so the context is current only
+//during a call and released before the next thread can take the lock
+template<typename Renderer>
+class ScopedContext
+{
+    Renderer &renderer;
+public:
+    explicit ScopedContext(Renderer &renderer) : renderer(renderer)
+    {
+        renderer.makeContextCurrent();
+    }
+
+    ~ScopedContext()
+    {
+        renderer.releaseContext();
+    }
+
+    ScopedContext(const ScopedContext&) = delete;
+    ScopedContext& operator=(const ScopedContext&) = delete;
+};
+
+
+//Calls the renderer with the GIL released and its context current. The renderer is locked only after the GIL is
+//released: a thread waiting for the lock while holding the GIL would block the thread which holds the lock from
+//reacquiring the GIL
+template<typename Renderer, typename Function>
+auto callWithoutGIL(std::mutex &renderer_mutex, Renderer &renderer, Function function) -> decltype(function())
+{
+    ScopedGILRelease gil_release;
+    std::lock_guard<std::mutex> lock(renderer_mutex);
+    ScopedContext<Renderer> context(renderer);
+    return function();
+}
+
+
+//Holds the GIL for the lifetime of the object, for calling Python back from code running under ScopedGILRelease
+class ScopedGILAcquire
+{
+    PyGILState_STATE gil_state;
+public:
+    ScopedGILAcquire() : gil_state(PyGILState_Ensure())
+    {
+    }
+
+    ~ScopedGILAcquire()
+    {
+        PyGILState_Release(gil_state);
+    }
+
+    ScopedGILAcquire(const ScopedGILAcquire&) = delete;
+    ScopedGILAcquire& operator=(const ScopedGILAcquire&) = delete;
+};
+
+
+//List of tuples with the same items as render_scene arguments (except render_semantic_labels)
+vector<SceneSpec> extractScenes(const bp::list &scenes, const PyModelHandles &model_handles)
+{
+    vector<SceneSpec> scene_specs;
+    for (int i = 0; i < bp::len(scenes); ++i)
+    {
+        bp::tuple scene_tuple = bp::extract<bp::tuple>(scenes[i]);
+        scene_specs.push_back(extractScene(
+                bp::extract<int>(scene_tuple[0]),
+                bp::extract<bp::tuple>(scene_tuple[1]),
+                bp::extract<bp::tuple>(scene_tuple[2]),
+                bp::extract<bp::tuple>(scene_tuple[3]),
+                bp::extract<bp::tuple>(scene_tuple[4]),
+                bp::extract<bp::tuple>(scene_tuple[5]),
+                bp::extract<bp::tuple>(scene_tuple[6]),
+                bp::extract<bp::tuple>(scene_tuple[7]),
+                bp::extract<double>(scene_tuple[8]),
+                bp::extract<bp::list>(scene_tuple[9]),
+                model_handles));
+    }
+    return scene_specs;
+}
+
+
+vector< pair<string, string> > extractModelsPaths(const bp::dict &models_to_paths)
+{
+    vector< pair<string, string> > models_paths;
+
+    bp::list object_items = models_to_paths.items();
+    for (int i = 0; i < bp::len(object_items); ++i)
+    {
+        bp::tuple item = bp::extract<bp::tuple>(object_items[i]);
+        string model_name = bp::extract<string>(item[0]);
+        string model_path = bp::extract<string>(item[1]);
+        models_paths.push_back({model_name, model_path});
+    }
+    return models_paths;
+}
+
+
+bp::dict modelsExtentToDict(const vector< tuple<string, glm::vec3, glm::vec3> > &models_extent)
+{
+    bp::dict models_extent_dict;
+    for (auto model_extent : models_extent)
+    {
+        const auto& [model_name, extent_min, extent_max] = model_extent;
+        models_extent_dict[model_name] = bp::make_tuple(
+                extent_min.x, extent_min.y, extent_min.z,
+                extent_max.x, extent_max.y, extent_max.z);
+    }
+    return models_extent_dict;
+}
+
+
+
+//Persistent scene of a SynthRenderer, created by its create_scene. The scene keeps the renderer alive, its GPU objects
+//belong to the renderer's context. The scene is modified under the lock of the renderer, as it may be rendering it
+class PySceneWrapper
+{
+    bp::object renderer_object;
+    const void *owner;
+    std::mutex *renderer_mutex;
+    SynthRenderer *renderer;
+    const PyModelHandles *model_handles;
+    shared_ptr<Scene> scene;
+public:
+    //The scene is deleted on whichever thread releases its last reference, with the renderer's context made current
+    PySceneWrapper(bp::object renderer_object, const void *owner, std::mutex &renderer_mutex, SynthRenderer &renderer,
+                   const PyModelHandles &model_handles) :
+            renderer_object(renderer_object),
+            owner(owner),
+            renderer_mutex(&renderer_mutex),
+            renderer(&renderer),
+            model_handles(&model_handles),
+            scene(new Scene(), [mutex = &renderer_mutex, renderer = &renderer](Scene *scene) {
+                callWithoutGIL(*mutex, *renderer, [&] { delete scene; });
+            })
+    {
+    }
+
+    bool isOwnedBy(const void *renderer) const
+    {
+        return owner == renderer;
+    }
+
+    Scene& getScene()
+    {
+        return *scene;
+    }
+
+    //Model alias or handle, properties as in render_scene. Static objects are rendered with the background once and
+    //reused until they or the settings change
+    int add_object(bp::object model, bp::dict properties, bool is_static)
+    {
+        ModelHandle model_handle = model_handles->find(model);
+        ObjectAttributes attributes = extractObjectAttributes(properties);
+        return callWithoutGIL(*renderer_mutex, *renderer, [&] { return scene->addObject(model_handle, attributes, is_static); });
+    }
+
+    void update_object(int object_id, bp::dict properties)
+    {
+        ObjectAttributes attributes = extractObjectAttributes(properties);
+        callWithoutGIL(*renderer_mutex, *renderer, [&] { scene->updateObject(object_id, attributes); });
+    }
+
+    void remove_object(int object_id)
+    {
+        callWithoutGIL(*renderer_mutex, *renderer, [&] { scene->removeObject(object_id); });
+    }
+
+    void set_settings(
+            int background_image_index,
+            bp::tuple camera_position,
+            bp::tuple camera_target,
+            bp::tuple camera_up,
+            bp::tuple sun_light_direction,
+            bp::tuple sun_light_color,
+            bp::tuple ambient_light_color,
+            bp::tuple search_light_color,
+            double search_light_angle
+    )
+    {
+        SceneSettings settings = extractSceneSettings(
+                background_image_index,
+                camera_position,
+                camera_target,
+                camera_up,
+                sun_light_direction,
+                sun_light_color,
+                ambient_light_color,
+                search_light_color,
+                search_light_angle);
+        callWithoutGIL(*renderer_mutex, *renderer, [&] { scene->settings = settings; });
+    }
+
+    int get_objects_count()
+    {
+        return callWithoutGIL(*renderer_mutex, *renderer, [&] { return scene->getObjectsCount(); });
+    }
+
+    bp::list get_object_ids()
+    {
+        vector<ObjectId> object_ids = callWithoutGIL(*renderer_mutex, *renderer, [&] { return scene->getObjectIds(); });
+        bp::list object_ids_list;
+        for (ObjectId object_id : object_ids)
+        {
+            object_ids_list.append(object_id);
+        }
+        return object_ids_list;
+    }
+};
+
+
+//Python inputs are parsed into C++ structs with the GIL held, rendering runs without the GIL and outputs are built
+//with the GIL again
 class PySynthRendererWrapper
 {
     SynthRenderer renderer;
+    std::mutex renderer_mutex;
+    OutputFormat output_format = OutputFormat::NUMPY;
+    PyModelHandles model_handles;
 public:
-    PySynthRendererWrapper(int width, int height) : renderer(width, height)
+    //The context is current only during calls, see ScopedContext
+    PySynthRendererWrapper(int width, int height, std::string backend = "glfw") : renderer(width, height, ContextBackendFromName(backend))
     {
+        renderer.releaseContext();
     }
 
     int add_background_images_folder(std::string folder)
     {
-        return renderer.addBackgroundImagesDirectory(folder);
+        return callWithoutGIL(renderer_mutex, renderer, [&] { return renderer.addBackgroundImagesDirectory(folder); });
     }
 
     int get_number_of_background_images()
     {
-        return renderer.getBackgroundImagesCount();
+        return callWithoutGIL(renderer_mutex, renderer, [&] { return renderer.getBackgroundImagesCount(); });
     }
 
-    void load_models(bp::dict models_to_paths)
+    void set_output_format(std::string format, bool page_locked)
     {
-        vector< pair<string, string> > models_paths;
+        output_format = outputFormatFromName(format);
+        callWithoutGIL(renderer_mutex, renderer, [&] { renderer.setPageLockedResults(page_locked); });
+    }
 
-        bp::list object_items = models_to_paths.items();
-        for (int i = 0; i < bp::len(object_items); ++i)
+    void set_label_statistics(bool enabled)
+    {
+        callWithoutGIL(renderer_mutex, renderer, [&] { renderer.setLabelStatistics(enabled); });
+    }
+
+    //Returns handles of the models, which scenes can refer to the models by instead of the aliases. Convex hulls with
+    //more than hull_max_vertices points (0 for no limit) are simplified, see SimplifyHull
+    bp::dict load_models(bp::dict models_to_paths, unsigned int hull_max_vertices, float hull_tolerance)
+    {
+        vector< pair<string, string> > models_paths = extractModelsPaths(models_to_paths);
+        const HullSimplification hull_simplification{hull_max_vertices, hull_tolerance};
+        vector<ModelHandle> loaded_handles = callWithoutGIL(renderer_mutex, renderer, [&] { return renderer.loadModels(models_paths, hull_simplification); });
+        model_handles.add(models_paths, loaded_handles);
+
+        bp::dict loaded_models_handles;
+        for (size_t i = 0; i < models_paths.size(); ++i)
         {
-            bp::tuple item = bp::extract<bp::tuple>(object_items[i]);
-            string model_name = bp::extract<string>(item[0]);
-            string model_path = bp::extract<string>(item[1]);
-            models_paths.push_back({model_name, model_path});
+            loaded_models_handles[models_paths[i].first] = loaded_handles[i];
         }
-
-        renderer.loadModels(models_paths);
+        return loaded_models_handles;
     }
 
 
     bp::dict get_models_extent()
     {
-        vector< tuple<string, glm::vec3, glm::vec3> > models_extent = renderer.getModelsExtent();
+        auto models_extent = callWithoutGIL(renderer_mutex, renderer, [&] { return renderer.getModelsExtent(); });
+        return modelsExtentToDict(models_extent);
+    }
+
+
+    bp::dict get_model_handles()
+    {
+        return model_handles.handles.copy();
+    }
+
+
+    static PySceneWrapper create_scene(bp::object self)
+    {
+        PySynthRendererWrapper &wrapper = bp::extract<PySynthRendererWrapper&>(self);
+        return PySceneWrapper(self, &wrapper, wrapper.renderer_mutex, wrapper.renderer, wrapper.model_handles);
+    }
+
 
-        bp::dict models_extent_dict;
-        for (auto model_extent : models_extent)
+    //Renders the persistent scene, bounding rects are in the order of the scene's object ids
+    bp::tuple renderPersistentScene(
+            PySceneWrapper &scene,
+            bool render_semantic_labels,
+            bp::object out
+    )
+    {
+        if (!scene.isOwnedBy(this))
         {
-            const auto& [model_name, extent_min, extent_max] = model_extent;
-            models_extent_dict[model_name] = bp::make_tuple(
-                    extent_min.x, extent_min.y, extent_min.z,
-                    extent_max.x, extent_max.y, extent_max.z);
+            throw std::runtime_error("Scene was created by another renderer");
         }
+        unsigned char *image_destination = out.is_none() ? nullptr : outputArrayData(out, renderer.getImageWidth(), renderer.getImageHeight());
 
-        return models_extent_dict;
+        SyntheticResult rendering_results = callWithoutGIL(renderer_mutex, renderer, [&] { return renderer.renderImage(scene.getScene(), render_semantic_labels, image_destination); });
+        return syntheticResultToTuple(rendering_results, model_handles.aliases, output_format, out);
     }
 
 
+    //Renders the persistent scene along the camera trajectory (float32 (N, 3) arrays), frames are read back while the
+    //next ones render. Without a callback returns the (N, H, W, 3) images with lists of the per frame bounding rects,
+    //labels and label statistics. Otherwise calls callback(frame_index, image, bounding_rects, semantic, instance, depth,
+    //label_statistics) for every frame as soon as it is read back and returns None; the renderer is busy during the
+    //callback, which must not use it
+    bp::object renderTrajectory(
+            PySceneWrapper &scene,
+            np::ndarray camera_positions,
+            np::ndarray camera_targets,
+            np::ndarray camera_ups,
+            bool render_semantic_labels,
+            bp::object callback
+    )
+    {
+        if (!scene.isOwnedBy(this))
+        {
+            throw std::runtime_error("Scene was created by another renderer");
+        }
+        vector<CameraView> trajectory = extractCameraViews(camera_positions, camera_targets, camera_ups);
+
+        if (!callback.is_none())
+        {
+            callWithoutGIL(renderer_mutex, renderer, [&] {
+                renderer.renderTrajectory(scene.getScene(), trajectory, render_semantic_labels,
+                        [&](size_t frame_index, SyntheticResult &frame) {
+                            ScopedGILAcquire gil_acquire;
+                            bp::tuple arguments(bp::make_tuple(frame_index) + syntheticResultToTuple(frame, model_handles.aliases, output_format));
+                            bp::handle<>(PyObject_CallObject(callback.ptr(), arguments.ptr()));
+                        });
+            });
+            return bp::object();
+        }
+
+        //Images of all the frames are read back into one buffer, labels are kept until the GIL is reacquired
+        const size_t image_bytes = (size_t)renderer.getImageWidth() * renderer.getImageHeight() * 3;
+        HostBuffer<unsigned char> images = AllocateHostBuffer<unsigned char>(std::max<size_t>(trajectory.size() * image_bytes, 1));
+        vector<SyntheticResult> frames;
+        frames.reserve(trajectory.size());
+        callWithoutGIL(renderer_mutex, renderer, [&] {
+            renderer.renderTrajectory(scene.getScene(), trajectory, render_semantic_labels,
+                    [&](size_t, SyntheticResult &frame) { frames.push_back(std::move(frame)); },
+                    images.get());
+        });
+
+        bp::object images_result = adoptAs(output_format, std::move(images),
+                {(Py_intptr_t)trajectory.size(), renderer.getImageHeight(), renderer.getImageWidth(), 3});
+        bp::list frames_bounding_rects;
+        bp::list semantic_segmentations;
+        bp::list instance_segmentations;
+        bp::list depths;
+        bp::list frames_label_statistics;
+        for (SyntheticResult &frame : frames)
+        {
+            frames_label_statistics.append(labelStatisticsOrNone(frame));
+            //The image of the frame is already in images_result
+            ResultImages frame_images = adoptResultImages(frame, output_format, images_result);
+            frames_bounding_rects.append(boundingRectsToList(frame.objects_bounding_rects, model_handles.aliases));
+            semantic_segmentations.append(frame_images.semantic_segmentation);
+            instance_segmentations.append(frame_images.instance_segmentation);
+            depths.append(frame_images.depth);
+        }
+        return bp::make_tuple(images_result, frames_bounding_rects, semantic_segmentations, instance_segmentations, depths,
+                frames_label_statistics);
+    }
 
 
     bp::tuple renderScene(
@@ -117,165 +1040,320 @@ public:
             bp::tuple ambient_light_color,
             bp::tuple search_light_color,
             double search_light_angle,
-            bp::list models,   // list of tuples (model_name, {scaling : <scaling>, x : <x>, y : <y>, z : <z>, yaw : <yaw>, pitch: <pitch>, roll : <roll>, semantic_class: <semantic class index>})
-            bool render_semantic_labels
+            bp::list models,   // list of tuples (model_name or model handle, {scaling : <scaling>, x : <x>, y : <y>, z : <z>, yaw : <yaw>, pitch: <pitch>, roll : <roll>, semantic_class: <semantic class index>})
+            bool render_semantic_labels,
+            bp::object out     // optional (height, width, 3) uint8 array the image is written to
     )
     {
-        //Extract objects information from python dictionary
-        vector< pair<string, ObjectAttributes> > models_attributes;
+        SceneSpec scene = extractScene(
+                background_image_index,
+                camera_position,
+                camera_target,
+                camera_up,
+                sun_light_direction,
+                sun_light_color,
+                ambient_light_color,
+                search_light_color,
+                search_light_angle,
+                models,
+                model_handles);
 
-        bp::list object_items = models;
-        for (int i = 0; i < bp::len(models); ++i)
-        {
+        //Render image
+        unsigned char *image_destination = out.is_none() ? nullptr : outputArrayData(out, renderer.getImageWidth(), renderer.getImageHeight());
+
+        SyntheticResult rendering_results = callWithoutGIL(renderer_mutex, renderer, [&] { return renderer.renderImage(scene, render_semantic_labels, image_destination); });
+        return syntheticResultToTuple(rendering_results, model_handles.aliases, output_format, out);
+    }
 
-            bp::tuple item = bp::extract<bp::tuple>(object_items[i]);
-            string model_name = bp::extract<string>(item[0]);
-            bp::dict object_properties_dict = bp::extract<bp::dict>(item[1]);
 
-            //bp::tuple object_position_tuple = bp::extract<bp::tuple>(item[1]);
+    //render_scene without the image: returns bounding rects, semantic and instance labels, depth and label statistics,
+    //at 1 / labels_downscale of the image size (bounding rects stay in full size image coordinates)
+    bp::tuple renderLabels(
+            int background_image_index,
+            bp::tuple camera_position,
+            bp::tuple camera_target,
+            bp::tuple camera_up,
+            bp::tuple sun_light_direction,
+            bp::tuple sun_light_color,
+            bp::tuple ambient_light_color,
+            bp::tuple search_light_color,
+            double search_light_angle,
+            bp::list models,   // same as in render_scene
+            unsigned int labels_downscale
+    )
+    {
+        SceneSpec scene = extractScene(
+                background_image_index,
+                camera_position,
+                camera_target,
+                camera_up,
+                sun_light_direction,
+                sun_light_color,
+                ambient_light_color,
+                search_light_color,
+                search_light_angle,
+                models,
+                model_handles);
 
-            float scaling, x, y, z, yaw, pitch, roll;
-            int semantic_label;
+        SyntheticResult rendering_results = callWithoutGIL(renderer_mutex, renderer, [&] { return renderer.renderLabels(scene, labels_downscale); });
+        return labelsResultToTuple(rendering_results, model_handles.aliases, output_format);
+    }
 
-            extractValueFromDict(object_properties_dict, SCALING_KEY, scaling);
-            extractValueFromDict(object_properties_dict, XKEY, x);
-            extractValueFromDict(object_properties_dict, YKEY, y);
-            extractValueFromDict(object_properties_dict, ZKEY, z);
-            extractValueFromDict(object_properties_dict, YAWKEY, yaw);
-            extractValueFromDict(object_properties_dict, PITCHKEY, pitch);
-            extractValueFromDict(object_properties_dict, ROLLKEY, roll);
-            extractValueFromDictOrDefault(object_properties_dict, SEMANTIC_CLASS_KEY, semantic_label, 0);
 
-            models_attributes.push_back({model_name, ObjectAttributes(scaling, x, y, z, yaw, pitch, roll, semantic_label)});
+    bp::tuple renderPersistentSceneLabels(PySceneWrapper &scene, unsigned int labels_downscale)
+    {
+        if (!scene.isOwnedBy(this))
+        {
+            throw std::runtime_error("Scene was created by another renderer");
         }
-        
-        //Extract camera and light positions from python tuples
-        glm::vec3 camera_position_vec = glm::vec3(
-            bp::extract<float>(camera_position[0]),
-            bp::extract<float>(camera_position[1]),
-            bp::extract<float>(camera_position[2])
-        );
+        SyntheticResult rendering_results = callWithoutGIL(renderer_mutex, renderer, [&] { return renderer.renderLabels(scene.getScene(), labels_downscale); });
+        return labelsResultToTuple(rendering_results, model_handles.aliases, output_format);
+    }
 
-        glm::vec3 camera_target_vec = glm::vec3(
-            bp::extract<float>(camera_target[0]),
-            bp::extract<float>(camera_target[1]),
-            bp::extract<float>(camera_target[2])
-        );
 
-        glm::vec3 camera_up_vec = glm::vec3(
-            bp::extract<float>(camera_up[0]),
-            bp::extract<float>(camera_up[1]),
-            bp::extract<float>(camera_up[2])
-        );
+    //render_scene with the objects given as parallel arrays instead of a list of dicts
+    bp::tuple renderSceneArrays(
+            int background_image_index,
+            bp::tuple camera_position,
+            bp::tuple camera_target,
+            bp::tuple camera_up,
+            bp::tuple sun_light_direction,
+            bp::tuple sun_light_color,
+            bp::tuple ambient_light_color,
+            bp::tuple search_light_color,
+            double search_light_angle,
+            np::ndarray model_handles_array,  // int32 (N,), handles from load_models or get_model_handles
+            np::ndarray poses,                // float32 (N, 6) rows of x, y, z, yaw, pitch, roll
+            np::ndarray scales,               // float32 (N,)
+            np::ndarray semantic_classes,     // int32 (N,)
+            bool render_semantic_labels,
+            bp::object out
+    )
+    {
+        SceneSettings settings = extractSceneSettings(
+                background_image_index,
+                camera_position,
+                camera_target,
+                camera_up,
+                sun_light_direction,
+                sun_light_color,
+                ambient_light_color,
+                search_light_color,
+                search_light_angle);
+        SceneSpec scene{settings, extractObjectsFromArrays(model_handles, model_handles_array, poses, scales, semantic_classes)};
 
-        glm::vec3 sun_light_direction_vec = glm::vec3(
-            bp::extract<float>(sun_light_direction[0]),
-            bp::extract<float>(sun_light_direction[1]),
-            bp::extract<float>(sun_light_direction[2])
-        );
+        unsigned char *image_destination = out.is_none() ? nullptr : outputArrayData(out, renderer.getImageWidth(), renderer.getImageHeight());
 
-        glm::vec3 sun_light_color_vec = glm::vec3(
-            bp::extract<float>(sun_light_color[0]),
-            bp::extract<float>(sun_light_color[1]),
-            bp::extract<float>(sun_light_color[2])
-        );
+        SyntheticResult rendering_results = callWithoutGIL(renderer_mutex, renderer, [&] { return renderer.renderImage(scene, render_semantic_labels, image_destination); });
+        return syntheticResultToArraysTuple(rendering_results, output_format, out);
+    }
 
-        glm::vec3 ambient_light_color_vec = glm::vec3(
-            bp::extract<float>(ambient_light_color[0]),
-            bp::extract<float>(ambient_light_color[1]),
-            bp::extract<float>(ambient_light_color[2])
-        );
 
-        glm::vec3 search_light_color_vec = glm::vec3(
-            bp::extract<float>(search_light_color[0]),
-            bp::extract<float>(search_light_color[1]),
-            bp::extract<float>(search_light_color[2])
-        );
+    long submitScene(
+            int background_image_index,
+            bp::tuple camera_position,
+            bp::tuple camera_target,
+            bp::tuple camera_up,
+            bp::tuple sun_light_direction,
+            bp::tuple sun_light_color,
+            bp::tuple ambient_light_color,
+            bp::tuple search_light_color,
+            double search_light_angle,
+            bp::list models,   // same as in render_scene
+            bool render_semantic_labels
+    )
+    {
+        SceneSpec scene = extractScene(
+                background_image_index,
+                camera_position,
+                camera_target,
+                camera_up,
+                sun_light_direction,
+                sun_light_color,
+                ambient_light_color,
+                search_light_color,
+                search_light_angle,
+                models,
+                model_handles);
 
-        //Render image
-        SyntheticResult rendering_results = renderer.renderImage(
-            models_attributes,
-            background_image_index,
-            camera_position_vec,
-            camera_target_vec,
-            camera_up_vec,
-            sun_light_direction_vec,
-            sun_light_color_vec,
-            ambient_light_color_vec,
-            search_light_color_vec,
-            search_light_angle,
-            render_semantic_labels);
-
-stbi_write_jpg("rendered.jpg", rendering_results.image.width, rendering_results.image.height, 3, rendering_results.image.data.get(), 100);
-
-        //Copy image data into numpy array
-        bp::tuple image_shape = bp::make_tuple(
-                rendering_results.image.height,
-                rendering_results.image.width, 
-                3);
-        np::ndarray image_result = np::zeros(image_shape, np::dtype::get_builtin<unsigned char>());
-//        std::copy(
-//                rendering_results.image.data.get(),
-//                rendering_results.image.data.get() + rendering_results.image.width * rendering_results.image.height * 3,
-//                image_result.get_data());
-for (int i = 0; i < rendering_results.image.width * rendering_results.image.height * 3; ++i)
-{
-    image_result.get_data()[i] = rendering_results.image.data.get()[i];
-}
-
-        bp::object semantic_segmentation_result_object;
-        //Copy semantic segmentation data into numpy array (if available)
-        if (rendering_results.semantic_segmentation.has_value())
-        {
+        return callWithoutGIL(renderer_mutex, renderer, [&] { return renderer.submitImage(scene, render_semantic_labels); });
+    }
 
-/*            
-            bp::tuple segmentation_shape = bp::make_tuple(
-                    rendering_results.image.height,
-                    rendering_results.image.width);
-            np::ndarray semantic_segmentation_result = np::zeros(segmentation_shape, np::dtype::get_builtin<int>());
-            for (int i = 0; i < rendering_results.image.width * rendering_results.image.height; ++i)
-            {            
-                int semantic_label = int(rendering_results.semantic_segmentation.value().data.get()[i * 3 + 2]) * 256 * 256 +
-                    int(rendering_results.semantic_segmentation.value().data.get()[i * 3 + 1]) * 256 +
-                    int(rendering_results.semantic_segmentation.value().data.get()[i * 3]);
-                semantic_segmentation_result.get_data()[i] = semantic_label;
-            }
-            semantic_segmentation_result_object = semantic_segmentation_result;
-*/            
-        np::ndarray semantic_segmentation_result = np::zeros(image_shape, np::dtype::get_builtin<unsigned char>());
-//        std::copy(
-//                rendering_results.image.data.get(),
-//                rendering_results.image.data.get() + rendering_results.image.width * rendering_results.image.height * 3,
-//                image_result.get_data());
-for (int i = 0; i < rendering_results.image.width * rendering_results.image.height * 3; ++i)
+
+    bool isSceneReady(long ticket)
+    {
+        return callWithoutGIL(renderer_mutex, renderer, [&] { return renderer.isImageReady(ticket); });
+    }
+
+
+    bp::tuple collectScene(long ticket)
+    {
+        SyntheticResult rendering_results = callWithoutGIL(renderer_mutex, renderer, [&] { return renderer.collectImage(ticket); });
+        return syntheticResultToTuple(rendering_results, model_handles.aliases, output_format);
+    }
+
+
+    bp::tuple renderBatch(
+            bp::list scenes   // list of tuples with the same items as render_scene arguments (except render_semantic_labels)
+    )
+    {
+        vector<SceneSpec> scene_specs = extractScenes(scenes, model_handles);
+
+        BatchResult batch_results = callWithoutGIL(renderer_mutex, renderer, [&] { return renderer.renderBatch(scene_specs); });
+        return batchResultToTuple(batch_results, model_handles.aliases, output_format);
+    }
+
+
+    bp::tuple renderViews(
+            int background_image_index,
+            np::ndarray camera_positions,   // float32 (N, 3), a view per row
+            np::ndarray camera_targets,     // float32 (N, 3)
+            np::ndarray camera_ups,         // float32 (N, 3)
+            bp::tuple sun_light_direction,
+            bp::tuple sun_light_color,
+            bp::tuple ambient_light_color,
+            bp::tuple search_light_color,
+            double search_light_angle,
+            bp::list models    // same as in render_scene
+    )
+    {
+        vector<CameraView> views = extractCameraViews(camera_positions, camera_targets, camera_ups);
+        //Camera of the settings is replaced by the views
+        SceneSettings settings = extractSceneSettings(
+                background_image_index,
+                bp::make_tuple(0.0f, 0.0f, 0.0f),
+                bp::make_tuple(0.0f, 0.0f, 0.0f),
+                bp::make_tuple(0.0f, 0.0f, 0.0f),
+                sun_light_direction,
+                sun_light_color,
+                ambient_light_color,
+                search_light_color,
+                search_light_angle);
+        SceneSpec scene{settings, extractObjects(models, model_handles)};
+
+        BatchResult batch_results = callWithoutGIL(renderer_mutex, renderer, [&] { return renderer.renderViews(scene, views); });
+        return batchResultToTuple(batch_results, model_handles.aliases, output_format);
+    }
+};
+
+
+//Same phases as PySynthRendererWrapper, the lock keeps Python threads from using the primary context at the same time
+class PyRendererPoolWrapper
 {
-    semantic_segmentation_result.get_data()[i] = rendering_results.semantic_segmentation.value().data.get()[i];
-}
-semantic_segmentation_result_object = semantic_segmentation_result;
+    RendererPool pool;
+    std::mutex pool_mutex;
+    OutputFormat output_format = OutputFormat::NUMPY;
+    PyModelHandles model_handles;
+public:
+    PyRendererPoolWrapper(int width, int height, int workers_count, std::string backend = "glfw") : pool(width, height, workers_count, ContextBackendFromName(backend))
+    {
+        pool.releaseContext();
+    }
 
+    int add_background_images_folder(std::string folder)
+    {
+        return callWithoutGIL(pool_mutex, pool, [&] { return pool.addBackgroundImagesDirectory(folder); });
+    }
 
-        }
+    int get_number_of_background_images()
+    {
+        return callWithoutGIL(pool_mutex, pool, [&] { return pool.getBackgroundImagesCount(); });
+    }
 
-        //Extract objects bounding boxes and convert them into python list
-        bp::list objects_bounding_rects = bp::list();
-        for (auto& object_bounding_rect : rendering_results.object_name_to_bounding_rect)
-        {
-            //Convert OpenGL "device" coordinates to image pixels coordinates
+    void set_output_format(std::string format, bool page_locked)
+    {
+        output_format = outputFormatFromName(format);
+        callWithoutGIL(pool_mutex, pool, [&] { pool.setPageLockedResults(page_locked); });
+    }
 
+    void set_label_statistics(bool enabled)
+    {
+        callWithoutGIL(pool_mutex, pool, [&] { pool.setLabelStatistics(enabled); });
+    }
 
-            bp::tuple object_bounding_rect_tuple = bp::make_tuple(
-                    object_bounding_rect.first, //object name
-                    object_bounding_rect.second.top_right.y,  //top
-                    object_bounding_rect.second.bottom_left.x, //left
-                    object_bounding_rect.second.bottom_left.y, //bottom 
-                    object_bounding_rect.second.top_right.x //right
-            );
+    int get_workers_count()
+    {
+        return pool.getWorkersCount();
+    }
 
-            objects_bounding_rects.append(object_bounding_rect_tuple);
+    //Returns handles of the models, which scenes can refer to the models by instead of the aliases. Convex hulls with
+    //more than hull_max_vertices points (0 for no limit) are simplified, see SimplifyHull
+    bp::dict load_models(bp::dict models_to_paths, unsigned int hull_max_vertices, float hull_tolerance)
+    {
+        vector< pair<string, string> > models_paths = extractModelsPaths(models_to_paths);
+        const HullSimplification hull_simplification{hull_max_vertices, hull_tolerance};
+        vector<ModelHandle> loaded_handles = callWithoutGIL(pool_mutex, pool, [&] { return pool.loadModels(models_paths, hull_simplification); });
+        model_handles.add(models_paths, loaded_handles);
+
+        bp::dict loaded_models_handles;
+        for (size_t i = 0; i < models_paths.size(); ++i)
+        {
+            loaded_models_handles[models_paths[i].first] = loaded_handles[i];
         }
+        return loaded_models_handles;
+    }
 
-        bp::tuple result = bp::make_tuple(image_result, objects_bounding_rects, semantic_segmentation_result_object);
-        return result;
+    bp::dict get_models_extent()
+    {
+        auto models_extent = callWithoutGIL(pool_mutex, pool, [&] { return pool.getModelsExtent(); });
+        return modelsExtentToDict(models_extent);
+    }
+
+    bp::dict get_model_handles()
+    {
+        return model_handles.handles.copy();
+    }
+
+    long submitScene(
+            int background_image_index,
+            bp::tuple camera_position,
+            bp::tuple camera_target,
+            bp::tuple camera_up,
+            bp::tuple sun_light_direction,
+            bp::tuple sun_light_color,
+            bp::tuple ambient_light_color,
+            bp::tuple search_light_color,
+            double search_light_angle,
+            bp::list models,   // same as in render_scene
+            bool render_semantic_labels
+    )
+    {
+        SceneSpec scene = extractScene(
+                background_image_index,
+                camera_position,
+                camera_target,
+                camera_up,
+                sun_light_direction,
+                sun_light_color,
+                ambient_light_color,
+                search_light_color,
+                search_light_angle,
+                models,
+                model_handles);
+
+        return callWithoutGIL(pool_mutex, pool, [&] { return pool.submitImage(scene, render_semantic_labels); });
+    }
+
+    bp::tuple collectNextScene()
+    {
+        SyntheticResult rendering_results = callWithoutGIL(pool_mutex, pool, [&] { return pool.collectNextImage(); });
+        return syntheticResultToTuple(rendering_results, model_handles.aliases, output_format);
+    }
+
+    bp::list renderScenes(
+            bp::list scenes,   // same as in render_batch
+            bool render_semantic_labels
+    )
+    {
+        vector<SceneSpec> scene_specs = extractScenes(scenes, model_handles);
+        vector<SyntheticResult> rendering_results = callWithoutGIL(pool_mutex, pool, [&] { return pool.renderImages(scene_specs, render_semantic_labels); });
+
+        bp::list results;
+        for (auto& rendering_result : rendering_results)
+        {
+            results.append(syntheticResultToTuple(rendering_result, model_handles.aliases, output_format));
+        }
+        return results;
     }
 };
 
@@ -284,12 +1362,102 @@ BOOST_PYTHON_MODULE(SynthRenderer)
     using namespace boost::python;
     Py_Initialize();
     boost::python::numpy::initialize();   
-    class_<PySynthRendererWrapper>("SynthRenderer", init<int, int>())
+    class_<PySynthRendererWrapper, boost::noncopyable>("SynthRenderer", init<int, int, bp::optional<std::string>>())
         .def("add_background_images_folder", &PySynthRendererWrapper::add_background_images_folder)
-        .def("render_scene", &PySynthRendererWrapper::renderScene)
+        .def("render_scene", &PySynthRendererWrapper::renderScene, (
+                bp::arg("background_image_index"),
+                bp::arg("camera_position"),
+                bp::arg("camera_target"),
+                bp::arg("camera_up"),
+                bp::arg("sun_light_direction"),
+                bp::arg("sun_light_color"),
+                bp::arg("ambient_light_color"),
+                bp::arg("search_light_color"),
+                bp::arg("search_light_angle"),
+                bp::arg("models"),
+                bp::arg("render_semantic_labels"),
+                bp::arg("out") = bp::object()))
+        .def("render_scene_arrays", &PySynthRendererWrapper::renderSceneArrays, (
+                bp::arg("background_image_index"),
+                bp::arg("camera_position"),
+                bp::arg("camera_target"),
+                bp::arg("camera_up"),
+                bp::arg("sun_light_direction"),
+                bp::arg("sun_light_color"),
+                bp::arg("ambient_light_color"),
+                bp::arg("search_light_color"),
+                bp::arg("search_light_angle"),
+                bp::arg("model_handles"),
+                bp::arg("poses"),
+                bp::arg("scales"),
+                bp::arg("semantic_classes"),
+                bp::arg("render_semantic_labels"),
+                bp::arg("out") = bp::object()))
+        .def("create_scene", &PySynthRendererWrapper::create_scene)
+        .def("render_persistent_scene", &PySynthRendererWrapper::renderPersistentScene, (
+                bp::arg("scene"),
+                bp::arg("render_semantic_labels"),
+                bp::arg("out") = bp::object()))
+        .def("render_trajectory", &PySynthRendererWrapper::renderTrajectory, (
+                bp::arg("scene"),
+                bp::arg("camera_positions"),
+                bp::arg("camera_targets"),
+                bp::arg("camera_ups"),
+                bp::arg("render_semantic_labels"),
+                bp::arg("callback") = bp::object()))
+        .def("render_labels", &PySynthRendererWrapper::renderLabels, (
+                bp::arg("background_image_index"),
+                bp::arg("camera_position"),
+                bp::arg("camera_target"),
+                bp::arg("camera_up"),
+                bp::arg("sun_light_direction"),
+                bp::arg("sun_light_color"),
+                bp::arg("ambient_light_color"),
+                bp::arg("search_light_color"),
+                bp::arg("search_light_angle"),
+                bp::arg("models"),
+                bp::arg("labels_downscale") = 1))
+        .def("render_persistent_scene_labels", &PySynthRendererWrapper::renderPersistentSceneLabels, (
+                bp::arg("scene"),
+                bp::arg("labels_downscale") = 1))
+        .def("render_batch", &PySynthRendererWrapper::renderBatch)
+        .def("render_views", &PySynthRendererWrapper::renderViews)
+        .def("submit_scene", &PySynthRendererWrapper::submitScene)
+        .def("is_scene_ready", &PySynthRendererWrapper::isSceneReady)
+        .def("collect_scene", &PySynthRendererWrapper::collectScene)
         .def("get_background_images_count", &PySynthRendererWrapper::get_number_of_background_images)
-        .def("load_models", &PySynthRendererWrapper::load_models)
+        .def("set_output_format", &PySynthRendererWrapper::set_output_format, (bp::arg("format"), bp::arg("page_locked") = false))
+        .def("set_label_statistics", &PySynthRendererWrapper::set_label_statistics)
+        .def("load_models", &PySynthRendererWrapper::load_models, (
+                bp::arg("models_to_paths"),
+                bp::arg("hull_max_vertices") = 0,
+                bp::arg("hull_tolerance") = 0.0f))
         .def("get_models_extent", &PySynthRendererWrapper::get_models_extent)
+        .def("get_model_handles", &PySynthRendererWrapper::get_model_handles)
+    ;
+    class_<PySceneWrapper>("Scene", no_init)
+        .def("add_object", &PySceneWrapper::add_object, (bp::arg("model"), bp::arg("properties"), bp::arg("is_static") = false))
+        .def("update_object", &PySceneWrapper::update_object)
+        .def("remove_object", &PySceneWrapper::remove_object)
+        .def("set_settings", &PySceneWrapper::set_settings)
+        .def("get_objects_count", &PySceneWrapper::get_objects_count)
+        .def("get_object_ids", &PySceneWrapper::get_object_ids)
+    ;
+    class_<PyRendererPoolWrapper, boost::noncopyable>("RendererPool", init<int, int, int, bp::optional<std::string>>())
+        .def("add_background_images_folder", &PyRendererPoolWrapper::add_background_images_folder)
+        .def("render_scenes", &PyRendererPoolWrapper::renderScenes)
+        .def("submit_scene", &PyRendererPoolWrapper::submitScene)
+        .def("collect_next_scene", &PyRendererPoolWrapper::collectNextScene)
+        .def("get_background_images_count", &PyRendererPoolWrapper::get_number_of_background_images)
+        .def("set_output_format", &PyRendererPoolWrapper::set_output_format, (bp::arg("format"), bp::arg("page_locked") = false))
+        .def("set_label_statistics", &PyRendererPoolWrapper::set_label_statistics)
+        .def("get_workers_count", &PyRendererPoolWrapper::get_workers_count)
+        .def("load_models", &PyRendererPoolWrapper::load_models, (
+                bp::arg("models_to_paths"),
+                bp::arg("hull_max_vertices") = 0,
+                bp::arg("hull_tolerance") = 0.0f))
+        .def("get_models_extent", &PyRendererPoolWrapper::get_models_extent)
+        .def("get_model_handles", &PyRendererPoolWrapper::get_model_handles)
     ;
 }
 
@@ -0,0 +1,222 @@
+#include <RendererPool.h>
+
+
+RendererPool::RendererPool(
+        unsigned int generate_image_width,
+        unsigned int generate_image_height,
+        unsigned int workers_count,
+        ContextBackend context_backend) : primary_renderer(generate_image_width, generate_image_height, context_backend)
+{
+    if (workers_count == 0)
+    {
+        throw runtime_error("Renderer pool needs at least one worker");
+    }
+
+    //Contexts are created on this thread (GLFW can create windows only on the main thread) and handed over to the workers
+    for (unsigned int i = 0; i < workers_count; i++)
+    {
+        worker_renderers.push_back(std::make_unique<SynthRenderer>(generate_image_width, generate_image_height, context_backend, &primary_renderer));
+        worker_renderers.back()->releaseContext();
+    }
+    primary_renderer.makeContextCurrent();
+
+    for (auto &worker_renderer : worker_renderers)
+    {
+        worker_threads.emplace_back(&RendererPool::workerLoop, this, std::ref(*worker_renderer));
+    }
+}
+
+
+RendererPool::~RendererPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        jobs.clear();
+    }
+    jobs_available.notify_all();
+    for (auto &worker_thread : worker_threads)
+    {
+        worker_thread.join();
+    }
+    //Worker renderers are destroyed here on the creating thread, before the primary renderer they share objects with.
+    //Each of them deletes its objects in its own context, which leaves no context current
+    worker_renderers.clear();
+}
+
+
+void RendererPool::workerLoop(SynthRenderer &renderer)
+{
+    renderer.makeContextCurrent();
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobs_available.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping)
+            {
+                break;
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            busy_workers_count++;
+        }
+
+        PendingResult pending;
+        try
+        {
+            pending.result = renderer.renderImage(job.scene, job.generate_labels);
+        }
+        catch (...)
+        {
+            pending.error = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            results.emplace(job.ticket, std::move(pending));
+            busy_workers_count--;
+        }
+        results_available.notify_all();
+    }
+    renderer.releaseContext();
+}
+
+
+void RendererPool::waitUntilIdle()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    results_available.wait(lock, [this] { return jobs.empty() && busy_workers_count == 0; });
+}
+
+
+unsigned int RendererPool::getWorkersCount() const
+{
+    return worker_renderers.size();
+}
+
+
+void RendererPool::makeContextCurrent()
+{
+    primary_renderer.makeContextCurrent();
+}
+
+
+void RendererPool::releaseContext()
+{
+    primary_renderer.releaseContext();
+}
+
+
+int RendererPool::addBackgroundImagesDirectory(const string &background_images_directory)
+{
+    waitUntilIdle();
+    int added_images_count = primary_renderer.addBackgroundImagesDirectory(background_images_directory);
+    //Objects created in one context are visible to the other contexts of the share group once the creation finished
+    glFinish();
+    return added_images_count;
+}
+
+
+int RendererPool::getBackgroundImagesCount() const
+{
+    return primary_renderer.getBackgroundImagesCount();
+}
+
+
+vector<ModelHandle> RendererPool::loadModels(const vector<pair<string, string>> &models_aliases_to_filenames,
+                                             const HullSimplification &hull_simplification)
+{
+    waitUntilIdle();
+    vector<ModelHandle> loaded_handles = primary_renderer.loadModels(models_aliases_to_filenames, hull_simplification);
+    glFinish();
+    return loaded_handles;
+}
+
+
+vector< tuple<string, glm::vec3, glm::vec3> > RendererPool::getModelsExtent() const
+{
+    return primary_renderer.getModelsExtent();
+}
+
+
+const vector<string>& RendererPool::getModelAliases() const
+{
+    return primary_renderer.getModelAliases();
+}
+
+
+void RendererPool::setPageLockedResults(bool page_locked)
+{
+    waitUntilIdle();
+    for (auto &worker_renderer : worker_renderers)
+    {
+        worker_renderer->setPageLockedResults(page_locked);
+    }
+}
+
+
+void RendererPool::setLabelStatistics(bool enabled)
+{
+    waitUntilIdle();
+    for (auto &worker_renderer : worker_renderers)
+    {
+        worker_renderer->setLabelStatistics(enabled);
+    }
+}
+
+
+long RendererPool::submitImage(const SceneSpec &scene, bool generate_labels)
+{
+    long ticket;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ticket = next_ticket++;
+        jobs.push_back(Job{ticket, scene, generate_labels});
+    }
+    jobs_available.notify_one();
+    return ticket;
+}
+
+
+SyntheticResult RendererPool::collectNextImage()
+{
+    PendingResult pending;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (next_collect_ticket == next_ticket)
+        {
+            throw runtime_error("No submitted image to collect");
+        }
+        results_available.wait(lock, [this] { return results.count(next_collect_ticket) != 0; });
+
+        auto found = results.find(next_collect_ticket);
+        pending = std::move(found->second);
+        results.erase(found);
+        next_collect_ticket++;
+    }
+
+    if (pending.error)
+    {
+        std::rethrow_exception(pending.error);
+    }
+    return std::move(pending.result);
+}
+
+
+vector<SyntheticResult> RendererPool::renderImages(const vector<SceneSpec> &scenes, bool generate_labels)
+{
+    for (const auto &scene : scenes)
+    {
+        submitImage(scene, generate_labels);
+    }
+
+    vector<SyntheticResult> rendered;
+    rendered.reserve(scenes.size());
+    for (size_t i = 0; i < scenes.size(); i++)
+    {
+        rendered.push_back(collectNextImage());
+    }
+    return rendered;
+}
@@ -0,0 +1,142 @@
+#include <Scene.h>
+
+
+Scene::~Scene()
+{
+    if (instance_VBO != 0)
+    {
+        glDeleteVertexArrays(VERTEX_FORMATS_COUNT, geometry_VAOs);
+        glDeleteBuffers(1, &instance_VBO);
+    }
+    for (SceneLayer &layer : layers)
+    {
+        layer.render_queue.Release();
+    }
+    if (static_layer_framebuffer != 0)
+    {
+        glDeleteFramebuffers(1, &static_layer_framebuffer);
+        glDeleteTextures(static_layer_textures.size(), static_layer_textures.data());
+        glDeleteRenderbuffers(1, &static_layer_rbo);
+    }
+}
+
+
+Scene::SceneObject& Scene::findObject(ObjectId object_id)
+{
+    auto found = objects.find(object_id);
+    if (found == objects.end())
+    {
+        throw runtime_error("Unknown scene object: " + std::to_string(object_id));
+    }
+    return found->second;
+}
+
+
+ObjectId Scene::addObject(ModelHandle model, const ObjectAttributes &attributes, bool is_static)
+{
+    if (model < 0)
+    {
+        throw runtime_error("Unknown model handle: " + std::to_string(model));
+    }
+
+    Layer layer_index = is_static ? STATIC_LAYER : DYNAMIC_LAYER;
+    SceneLayer &layer = layers[layer_index];
+    if ((size_t)model >= layer.instances_per_model.size())
+    {
+        layer.instances_per_model.resize(model + 1);
+        layer.objects_per_model.resize(model + 1);
+    }
+
+    ObjectId object_id;
+    if (!free_object_ids.empty())
+    {
+        object_id = *free_object_ids.begin();
+        free_object_ids.erase(free_object_ids.begin());
+    }
+    else
+    {
+        object_id = next_object_id++;
+    }
+    objects.emplace(object_id, SceneObject{model, layer_index, attributes, (unsigned int)layer.instances_per_model[model].size()});
+    layer.instances_per_model[model].push_back(InstanceData{
+            getModelMatrix(attributes),
+            static_cast<GLuint>(attributes.semantic_class_id),
+            static_cast<GLuint>(object_id + 1)});
+    layer.objects_per_model[model].push_back(object_id);
+
+    layout_dirty = true;
+    if (is_static)
+    {
+        static_objects_count++;
+        static_layer_valid = false;
+    }
+    return object_id;
+}
+
+
+void Scene::removeObject(ObjectId object_id)
+{
+    SceneObject &object = findObject(object_id);
+    SceneLayer &layer = layers[object.layer];
+    vector<InstanceData> &model_instances = layer.instances_per_model[object.model];
+    vector<ObjectId> &model_objects = layer.objects_per_model[object.model];
+
+    //The last instance of the model takes the place of the removed one
+    unsigned int last_index = model_instances.size() - 1;
+    if (object.instance_index != last_index)
+    {
+        model_instances[object.instance_index] = model_instances[last_index];
+        model_objects[object.instance_index] = model_objects[last_index];
+        objects.at(model_objects[last_index]).instance_index = object.instance_index;
+    }
+    model_instances.pop_back();
+    model_objects.pop_back();
+
+    layout_dirty = true;
+    if (object.layer == STATIC_LAYER)
+    {
+        static_objects_count--;
+        static_layer_valid = false;
+    }
+    objects.erase(object_id);
+    free_object_ids.insert(object_id);
+}
+
+
+void Scene::updateObject(ObjectId object_id, const ObjectAttributes &attributes)
+{
+    SceneObject &object = findObject(object_id);
+    object.attributes = attributes;
+
+    InstanceData &instance = layers[object.layer].instances_per_model[object.model][object.instance_index];
+    instance.ModelMatrix = getModelMatrix(attributes);
+    instance.ClassId = static_cast<GLuint>(attributes.semantic_class_id);
+
+    if (!object.dirty)
+    {
+        object.dirty = true;
+        dirty_objects.push_back(object_id);
+    }
+    if (object.layer == STATIC_LAYER)
+    {
+        static_layer_valid = false;
+    }
+}
+
+
+size_t Scene::getObjectsCount() const
+{
+    return objects.size();
+}
+
+
+vector<ObjectId> Scene::getObjectIds() const
+{
+    vector<ObjectId> object_ids;
+    object_ids.reserve(objects.size());
+    for (const auto &id_object : objects)
+    {
+        object_ids.push_back(id_object.first);
+    }
+    return object_ids;
+}
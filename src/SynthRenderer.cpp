@@ -1,4 +1,5 @@
 #include <SynthRenderer.h>
+#include <Scene.h>
 
 #include <algorithm>
 #include <glm/ext/matrix_transform.hpp>
@@ -17,6 +18,29 @@
 using std::numeric_limits;
 using std::tuple;
 
+
+SharedRenderResources::~SharedRenderResources()
+{
+    glDeleteTextures(background_texture_objects.size(), background_texture_objects.data());
+    for (const Model &model : models)
+    {
+        for (const Texture &texture : model.textures_loaded)
+        {
+            glDeleteTextures(1, &texture.id);
+        }
+    }
+    for (const auto &color_texture : default_textures)
+    {
+        glDeleteTextures(1, &color_texture.second);
+    }
+    for (GeometryArena &geometry_arena : geometry_arenas)
+    {
+        geometry_arena.Release();
+    }
+    material_uniform_buffer.Release();
+}
+
+
 void SynthRenderer::initBackgroundObjects()
 {
     glGenBuffers(1, &background_VBO);
@@ -36,7 +60,7 @@ void SynthRenderer::initBackgroundObjects()
 
 int SynthRenderer::getBackgroundImagesCount() const
 {
-    return background_texture_objects.size();
+    return resources->background_texture_objects.size();
 };
 
 
@@ -85,7 +109,7 @@ int SynthRenderer::addBackgroundImagesDirectory(
 
                 glBindTexture(GL_TEXTURE_2D, 0);
 
-                background_texture_objects.push_back(texture_object);
+                resources->background_texture_objects.push_back(texture_object);
                 added_images_count++;
             };
         }
@@ -95,42 +119,163 @@ int SynthRenderer::addBackgroundImagesDirectory(
 };
 
 
-void SynthRenderer::loadModels(const vector<pair<string, string>> &models_aliases_to_filenames) 
+vector<ModelHandle> SynthRenderer::loadModels(const vector<pair<string, string>> &models_aliases_to_filenames,
+                                              const HullSimplification &hull_simplification)
 {
+    vector<ModelHandle> loaded_handles;
     for (const auto &model_alias_filename : models_aliases_to_filenames)
     {
+        auto loaded = resources->model_handles.find(model_alias_filename.first);
+        if (loaded != resources->model_handles.end())
+        {
+            loaded_handles.push_back(loaded->second);
+            continue;
+        }
+
         clog << "Loading model with alias: " << model_alias_filename.first
               << " filename: " << model_alias_filename.second << endl;
-        models.emplace(model_alias_filename.first, Model(model_alias_filename.second));
+        size_t first_material = resources->materials.size();
+        ModelHandle handle = resources->models.size();
+        resources->models.push_back(Model(model_alias_filename.second, resources->default_textures, false, hull_simplification));
+        clog << "Convex hull points: " << resources->models.back().convexHullPoints.size() << endl;
+        resources->model_aliases.push_back(model_alias_filename.first);
+        resources->model_handles.emplace(model_alias_filename.first, handle);
+        loaded_handles.push_back(handle);
+
+        //Pack the meshes of the new model into the shared vertex and index buffers, the material index of a mesh is
+        //stored with its vertices
+        for (Mesh &mesh : resources->models.back().meshes)
+        {
+            mesh.SetMaterialIndex(findOrAddMaterial(mesh.GetMaterialUniforms()));
+            resources->geometry_arenas[mesh.GetVertexFormat()].Add(mesh);
+        }
+        updateMaterialUniformBuffer(first_material);
     };
+
+    for (GeometryArena &geometry_arena : resources->geometry_arenas)
+    {
+        geometry_arena.Upload();
+    }
+    return loaded_handles;
 };
 
 
-bool SynthRenderer::initGL()
+void SynthRenderer::initUniformBuffers()
+{
+    frame_uniform_buffer.Allocate(sizeof(FrameUniforms));
+    frame_uniform_buffer.BindBase(FRAME_UNIFORM_BLOCK_BINDING);
+
+    //Uniform block bindings and texture units of the samplers never change, so they are set once
+    model_shader.value().bindUniformBlock("FrameData", FRAME_UNIFORM_BLOCK_BINDING);
+    model_shader.value().bindUniformBlock("MaterialData", MATERIAL_UNIFORM_BLOCK_BINDING);
+    labels_shader.value().bindUniformBlock("FrameData", FRAME_UNIFORM_BLOCK_BINDING);
+    model_shader.value().use();
+    for (unsigned int unit = 0; unit < TEXTURE_UNITS_COUNT; ++unit)
+    {
+        model_shader.value().setInt(TEXTURE_UNIT_SAMPLERS[unit], unit);
+    }
+
+    background_shader.value().use();
+    background_shader.value().setInt("texture1", 0);
+
+    if (label_statistics_shader.has_value())
+    {
+        label_statistics_shader.value().use();
+        label_statistics_shader.value().setInt("instance_labels", 0);
+    }
+    glUseProgram(0);
+}
+
+
+unsigned int SynthRenderer::findOrAddMaterial(const MaterialUniforms &material)
+{
+    //Only the properties the shader reads tell materials apart
+    array<float, 10> key = {material.Kd.r, material.Kd.g, material.Kd.b,
+                            material.Ks.r, material.Ks.g, material.Ks.b,
+                            material.Ka.r, material.Ka.g, material.Ka.b,
+                            material.Ns};
+    auto found = resources->material_indices.find(key);
+    if (found != resources->material_indices.end())
+    {
+        return found->second;
+    }
+
+    if (resources->materials.size() >= MAX_MATERIALS)
+    {
+        throw runtime_error("More than " + std::to_string(MAX_MATERIALS) + " distinct materials in loaded models");
+    }
+    unsigned int index = resources->materials.size();
+    resources->materials.push_back(material);
+    resources->material_indices.emplace(key, index);
+    return index;
+}
+
+
+void SynthRenderer::updateMaterialUniformBuffer(size_t first_material)
+{
+    //Records of the array are tightly packed, the std140 array stride of the Material struct is its size
+    static_assert(sizeof(MaterialUniforms) % 16 == 0, "MaterialUniforms must match std140 array stride");
+    if (first_material < resources->materials.size())
+    {
+        resources->material_uniform_buffer.Update(resources->materials.data() + first_material,
+                (resources->materials.size() - first_material) * sizeof(MaterialUniforms),
+                first_material * sizeof(MaterialUniforms));
+    }
+}
+
+
+void SynthRenderer::initGL(const SynthRenderer *share_resources_with)
 {
-    glfwInit();
-    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    this->offscreen_window = glfwCreateWindow(generate_image_width, generate_image_height, "", NULL, NULL);
-    if (this->offscreen_window == NULL)
+    //OpenGL 4.3 is preferred for multi-draw indirect submission, everything else works with 3.3
+    this->context = GLContext::Create(context_backend, generate_image_width, generate_image_height,
+            share_resources_with != nullptr ? share_resources_with->context.get() : nullptr);
+    if (!this->context)
     {
-        clog << "Failed to create GLFW window" << endl;
-        glfwTerminate();
-        return false;
+        //The backend logs why
+        throw runtime_error("Failed to create OpenGL context");
     }
-    glfwMakeContextCurrent(this->offscreen_window);
+    this->context->MakeCurrent();
 
     //glad: Load all OpenGL function pointers
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    if (!gladLoadGLLoader(this->context->GetProcAddressFunction()))
+    {
+        this->context->ReleaseCurrent();
+        throw runtime_error("Failed to initialize GLAD");
+    }
+
+    //All the materials are in one uniform block array, which must fit the uniform block size limit
+    GLint max_uniform_block_size;
+    glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &max_uniform_block_size);
+    if (max_uniform_block_size < static_cast<GLint>(MAX_MATERIALS * sizeof(MaterialUniforms)))
+    {
+        this->context->ReleaseCurrent();
+        throw runtime_error("Maximum uniform block size " + std::to_string(max_uniform_block_size) + " is too small for " +
+                            std::to_string(MAX_MATERIALS) + " materials");
+    }
+
+    try
+    {
+        createGLObjects(share_resources_with);
+    }
+    catch (...)
     {
-        clog << "Failed to initialize GLAD" << endl;
-        return false;
+        //The destructor doesn't run for a renderer whose constructor throws
+        deleteGLObjects();
+        this->context->ReleaseCurrent();
+        throw;
     }
+}
 
+
+void SynthRenderer::createGLObjects(const SynthRenderer *share_resources_with)
+{
+    //Depth and face culling state is the same for everything we draw, so it is set up once
     glEnable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+    glDepthFunc(GL_LESS);
     glViewport(0, 0, generate_image_width, generate_image_height);
+    //Rows of read back images are tightly packed
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
 
     clog << "Loading background shader" << endl;
     this->background_shader.emplace("shaders/vertex_texture_passthrough.glsl", "shaders/fragment_flat_texture.glsl");
@@ -138,68 +283,176 @@ bool SynthRenderer::initGL()
     clog << "Loading model rendering shader" << endl;
     this->model_shader.emplace("shaders/vertex_project.glsl", "shaders/fragment_light.glsl");
 
-    clog << "Loading semantic segmentation shader" << endl;
-    this->semantic_segmentation_shader.emplace("shaders/vertex_project.glsl", "shaders/fragment_uniform.glsl");
+    clog << "Loading labels shader" << endl;
+    this->labels_shader.emplace("shaders/vertex_labels.glsl", "shaders/fragment_labels.glsl");
+
+    if (GLAD_GL_VERSION_4_3)
+    {
+        clog << "Loading label statistics shader" << endl;
+        this->label_statistics_shader.emplace("shaders/compute_label_statistics.glsl");
+    }
 
     initBackgroundObjects();
+    initReadbackObjects();
+    initUniformBuffers();
+
+    //Geometry of all the models lives in one arena per vertex format, instances of all the models in one instance buffer
+    if (share_resources_with != nullptr)
+    {
+        resources = share_resources_with->resources;
+    }
+    else
+    {
+        resources = std::make_shared<SharedRenderResources>();
+        for (unsigned int format = 0; format < VERTEX_FORMATS_COUNT; format++)
+        {
+            resources->geometry_arenas[format].Init(static_cast<VertexFormat>(format));
+        }
+        resources->material_uniform_buffer.Allocate(MAX_MATERIALS * sizeof(MaterialUniforms), nullptr, GL_STATIC_DRAW);
+    }
+    //Buffer binding points are per context, the materials stay bound for the whole life of the context
+    resources->material_uniform_buffer.BindBase(MATERIAL_UNIFORM_BLOCK_BINDING);
+    glGenBuffers(1, &instance_VBO);
+    for (unsigned int format = 0; format < VERTEX_FORMATS_COUNT; format++)
+    {
+        geometry_VAOs[format] = resources->geometry_arenas[format].CreateVertexArray(instance_VBO);
+    }
+    render_queue.SetMultiDrawIndirect(GLAD_GL_VERSION_4_3);
+    clog << "Multi-draw indirect submission: " << (GLAD_GL_VERSION_4_3 ? "enabled" : "disabled") << endl;
+    clog << "Convex hull projection kernel: " << HullProjectionKernelName() << endl;
 
     //Init framebeuffer for rendering scene to
     glGenFramebuffers(1, &framebuffer_object);
     glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_object);
 
-    //Create the texture for rendering to
-    glGenTextures(1, &generated_image_texture_object);
-    glBindTexture(GL_TEXTURE_2D, generated_image_texture_object);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, generate_image_width, generate_image_height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    //Attach the texture to the framebuffer
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, generated_image_texture_object, 0);
-
-    //Create a renderbuffer object for depth and stencil attachment
-    glGenRenderbuffers(1, &rbo);
-    glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, generate_image_width, generate_image_height);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo);    
+    //Create the textures for rendering to: shaded image and labels
+    GLuint attachment_textures[framebuffer_attachments_count];
+    createAttachmentTextures(attachment_textures, rbo);
+    generated_image_texture_object = attachment_textures[0];
+    semantic_segmentation_texture_object = attachment_textures[1];
+    instance_segmentation_texture_object = attachment_textures[2];
+    depth_texture_object = attachment_textures[3];
 
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
     {
         throw runtime_error("Framebuffer is not complete!");
     };
 
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
 
-    //Init framebuffers for rendering semantic segmentation masks
-    glGenFramebuffers(1, &semantic_segmentation_framebuffer_object);
-    glBindFramebuffer(GL_FRAMEBUFFER, semantic_segmentation_framebuffer_object);
-
-    //Create the texture
-    glGenTextures(1, &semantic_segmentation_texture_object);
-    glBindTexture(GL_TEXTURE_2D, semantic_segmentation_texture_object);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, generate_image_width, generate_image_height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+void SynthRenderer::createAttachmentTextures(GLuint *texture_objects, GLuint &depth_rbo)
+{
+    auto createAttachmentTexture = [this](GLuint &texture_object, GLint internal_format, GLenum format, GLenum type, GLenum attachment) {
+        glGenTextures(1, &texture_object);
+        glBindTexture(GL_TEXTURE_2D, texture_object);
+        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, generate_image_width, generate_image_height, 0, format, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        //Attach the texture to the framebuffer
+        glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture_object, 0);
+    };
 
-    //Attach the texture to the framebuffer
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, semantic_segmentation_texture_object, 0);
+    createAttachmentTexture(texture_objects[0], GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE, GL_COLOR_ATTACHMENT0);
+    //Semantic class and instance index are written as integers
+    createAttachmentTexture(texture_objects[1], GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, GL_COLOR_ATTACHMENT1);
+    createAttachmentTexture(texture_objects[2], GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, GL_COLOR_ATTACHMENT2);
+    createAttachmentTexture(texture_objects[3], GL_R32F, GL_RED, GL_FLOAT, GL_COLOR_ATTACHMENT3);
+    glBindTexture(GL_TEXTURE_2D, 0);
 
     //Create a renderbuffer object for depth and stencil attachment
-    glGenRenderbuffers(1, &semantic_segmentation_rbo);
-    glBindRenderbuffer(GL_RENDERBUFFER, semantic_segmentation_rbo);
+    glGenRenderbuffers(1, &depth_rbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth_rbo);
     glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, generate_image_width, generate_image_height);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, semantic_segmentation_rbo);    
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth_rbo);
+}
 
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-    {
-        throw runtime_error("Segments framebuffer is not complete!"); 
-    };
 
-    return true;
+void SynthRenderer::setPageLockedResults(bool page_locked)
+{
+    page_locked_results = page_locked;
+}
+
+
+void SynthRenderer::setLabelStatistics(bool enabled)
+{
+    label_statistics = enabled;
+}
+
+
+void SynthRenderer::makeContextCurrent()
+{
+    context->MakeCurrent();
+}
+
+
+void SynthRenderer::releaseContext()
+{
+    context->ReleaseCurrent();
+}
+
+
+SynthRenderer::~SynthRenderer()
+{
+    context->MakeCurrent();
+    deleteGLObjects();
+    context->ReleaseCurrent();
+}
+
+
+void SynthRenderer::deleteGLObjects()
+{
+    cleanupGL();
+    //The last renderer of the share group deletes the shared objects, while its context is still current
+    resources.reset();
+    //Deletions are visible to the other contexts of the share group once they are done
+    glFinish();
 }
 
+
 void SynthRenderer::cleanupGL()
 {
+    for (const optional<Shader> *shader : {&background_shader, &model_shader, &labels_shader, &label_statistics_shader})
+    {
+        if (shader->has_value())
+        {
+            glDeleteProgram(shader->value().ID);
+        }
+    }
+    glDeleteVertexArrays(1, &background_VAO);
+    glDeleteBuffers(1, &background_VBO);
+    frame_uniform_buffer.Release();
+
+    glDeleteVertexArrays(VERTEX_FORMATS_COUNT, geometry_VAOs);
+    glDeleteBuffers(1, &instance_VBO);
+    render_queue.Release();
+
+    GLuint attachment_textures[framebuffer_attachments_count] = {
+        generated_image_texture_object, semantic_segmentation_texture_object, instance_segmentation_texture_object, depth_texture_object
+    };
+    glDeleteTextures(framebuffer_attachments_count, attachment_textures);
+    glDeleteRenderbuffers(1, &rbo);
     glDeleteFramebuffers(1, &framebuffer_object);
+    framebuffer_object = 0;
+
+    for (ReadbackSlot &slot : readback_slots)
+    {
+        if (slot.fence != nullptr)
+        {
+            glDeleteSync(slot.fence);
+        }
+        GLuint slot_buffers[] = {slot.image_pbo, slot.semantic_segmentation_pbo, slot.instance_segmentation_pbo, slot.depth_pbo, slot.label_statistics_ssbo};
+        glDeleteBuffers(sizeof(slot_buffers) / sizeof(slot_buffers[0]), slot_buffers);
+    }
+    readback_slots.clear();
+
+    if (batch_framebuffer_object != 0)
+    {
+        glDeleteFramebuffers(1, &batch_framebuffer_object);
+        glDeleteTextures(1, &batch_texture_array_object);
+        glDeleteRenderbuffers(1, &batch_rbo);
+    }
 }
 
 
@@ -211,8 +464,7 @@ void SynthRenderer::drawBackground(int background_index)
     background_shader.value().use();
     glBindVertexArray(background_VAO);
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, background_texture_objects[background_index]);
-    glUniform1i(glGetUniformLocation(background_shader.value().ID, "texture1"), 0);
+    glBindTexture(GL_TEXTURE_2D, resources->background_texture_objects[background_index]);
     glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
     glBindVertexArray(0);
 
@@ -233,177 +485,1120 @@ glm::mat4 getModelMatrix(const ObjectAttributes& attributes)
         return model_matrix;
 }
 
+void SynthRenderer::checkModelHandles(const vector< pair<ModelHandle, ObjectAttributes> > &models_to_positions) const
+{
+    for (const auto &handle_object : models_to_positions)
+    {
+        if (handle_object.first < 0 || handle_object.first >= (ModelHandle)resources->models.size())
+        {
+            throw runtime_error("Unknown model handle: " + std::to_string(handle_object.first));
+        }
+    }
+}
+
+
 void SynthRenderer::drawModels(
-        vector< pair<string, ObjectAttributes> > &models_to_positions,
+        const vector< pair<ModelHandle, ObjectAttributes> > &models_to_positions,
+        Shader &shader)
+{
+    prepareModels(models_to_positions, shader);
+
+    //Submit the draws ordered by state
+    render_queue.Submit(geometry_VAOs, instance_VBO);
+}
+
+
+void SynthRenderer::prepareModels(
+        const vector< pair<ModelHandle, ObjectAttributes> > &models_to_positions,
         Shader &shader)
 {
-    for (auto name_object : models_to_positions)
+    //Group the objects by model, keeping the buffers allocated between frames
+    instances_per_model.resize(resources->models.size());
+    for (auto& model_instances : instances_per_model)
+    {
+        model_instances.clear();
+    }
+
+    GLuint instance_index = 0;
+    for (const auto &handle_object : models_to_positions)
+    {
+        //Position the model for rendering, instance index starts from one, zero is left for background
+        instance_index++;
+        instances_per_model[handle_object.first].push_back(InstanceData{
+                getModelMatrix(handle_object.second),
+                static_cast<GLuint>(handle_object.second.semantic_class_id),
+                instance_index});
+    }
+
+    //Lay out the instances of each model as a contiguous range of one instance buffer and collect the draws
+    frame_instances.clear();
+    render_queue.Clear();
+    for (size_t handle = 0; handle < instances_per_model.size(); ++handle)
+    {
+        const vector<InstanceData> &model_instances = instances_per_model[handle];
+        if (model_instances.empty())
+        {
+            continue;
+        }
+        GLuint base_instance = static_cast<GLuint>(frame_instances.size());
+        frame_instances.insert(frame_instances.end(), model_instances.begin(), model_instances.end());
+        resources->models[handle].Enqueue(render_queue, shader, static_cast<GLsizei>(model_instances.size()), base_instance);
+    }
+
+    //Re-specify the whole buffer, so the driver doesn't wait for previous draws that are still using it
+    glBindBuffer(GL_ARRAY_BUFFER, instance_VBO);
+    glBufferData(GL_ARRAY_BUFFER, frame_instances.size() * sizeof(InstanceData), frame_instances.data(), GL_STREAM_DRAW);
+
+    render_queue.Sort();
+}
+
+
+vector< pair<ModelHandle, Rect> > SynthRenderer::computeObjectsBoundingRects(
+        const vector< pair<ModelHandle, ObjectAttributes> > &models_to_positions,
+        const glm::mat4 &projection_view_matrix
+) const
+{
+    checkModelHandles(models_to_positions);
+
+    vector<HullProjectionJob> jobs;
+    jobs.reserve(models_to_positions.size());
+    for (const auto &handle_object : models_to_positions)
     {
-        //Lookup the 3d model by name:
-        Model& model = models.find(name_object.first)->second;
+        jobs.push_back(HullProjectionJob{&resources->models[handle_object.first].convexHullSoA, projection_view_matrix * getModelMatrix(handle_object.second)});
+    }
+    vector<Rect> bounding_rects = projectBoundingRects(jobs);
 
-        //Position the model for rendering:
-        glm::mat4 model_matrix = getModelMatrix(name_object.second);
+    vector< pair<ModelHandle, Rect> > result;
+    result.reserve(models_to_positions.size());
+    for (size_t i = 0; i < models_to_positions.size(); ++i)
+    {
+        result.push_back(make_pair(models_to_positions[i].first, bounding_rects[i]));
+    }
 
-        //Draw the model
-        shader.setMat4("model", model_matrix);
+    return result;
+}
 
-        uint8_t class_id_lo = name_object.second.semantic_class_id & 0xFF;
-        uint8_t class_id_med = (name_object.second.semantic_class_id >> 8) & 0xFF;
-        uint8_t class_id_hi = (name_object.second.semantic_class_id >> 16) & 0xFF;        
-        glm::vec3 class_id_vec(class_id_lo / 255.0f, class_id_med / 255.0f, class_id_hi / 255.0f);
 
-clog << "Setting draw color: " << class_id_vec.x << " " << class_id_vec.y << " " << class_id_vec.z << endl;
+vector< vector< pair<ModelHandle, Rect> > > SynthRenderer::computeObjectsBoundingRects(
+        const vector< pair<ModelHandle, ObjectAttributes> > &models_to_positions,
+        const vector<glm::mat4> &projection_view_matrices
+) const
+{
+    checkModelHandles(models_to_positions);
 
-        shader.setVec3("draw_color", class_id_vec);
+    //Model matrix of every object is computed once for all the views, jobs go object by object
+    const size_t views_count = projection_view_matrices.size();
+    vector<HullProjectionJob> jobs;
+    jobs.reserve(models_to_positions.size() * views_count);
+    for (const auto &handle_object : models_to_positions)
+    {
+        const HullPoints *hull = &resources->models[handle_object.first].convexHullSoA;
+        glm::mat4 model_matrix = getModelMatrix(handle_object.second);
+        for (size_t view = 0; view < views_count; ++view)
+        {
+            jobs.push_back(HullProjectionJob{hull, projection_view_matrices[view] * model_matrix});
+        }
+    }
+    vector<Rect> bounding_rects = projectBoundingRects(jobs);
 
-        glEnable(GL_DEPTH_TEST);
-        glDisable(GL_CULL_FACE);
-        glDepthFunc(GL_LESS);
-        model.Draw(shader);
+    vector< vector< pair<ModelHandle, Rect> > > result(views_count);
+    for (size_t view = 0; view < views_count; ++view)
+    {
+        result[view].reserve(models_to_positions.size());
+        for (size_t i = 0; i < models_to_positions.size(); ++i)
+        {
+            result[view].push_back(make_pair(models_to_positions[i].first, bounding_rects[i * views_count + view]));
+        }
     }
+
+    return result;
 }
 
 
-vector< pair<string, Rect> > SynthRenderer::computeObjectsBoundingRects(
-        vector< pair<string, ObjectAttributes> > &models_to_positions,
+vector< pair<ModelHandle, Rect> > SynthRenderer::computeObjectsBoundingRects(
+        const Scene &scene,
         const glm::mat4 &projection_view_matrix
-)
+) const
 {
-    vector< pair<string, Rect> > result;
+    //Model matrices of the objects are kept in their instance data
+    vector<HullProjectionJob> jobs;
+    jobs.reserve(scene.objects.size());
+    for (const auto &id_object : scene.objects)
+    {
+        const Scene::SceneObject &object = id_object.second;
+        const glm::mat4 &model_matrix = scene.layers[object.layer].instances_per_model[object.model][object.instance_index].ModelMatrix;
+        jobs.push_back(HullProjectionJob{&resources->models[object.model].convexHullSoA, projection_view_matrix * model_matrix});
+    }
+    vector<Rect> bounding_rects = projectBoundingRects(jobs);
 
-    for (auto name_object : models_to_positions)
+    vector< pair<ModelHandle, Rect> > result;
+    result.reserve(scene.objects.size());
+    size_t i = 0;
+    for (const auto &id_object : scene.objects)
     {
-        //Lookup the 3d model by name:
-        Model& model = models.find(name_object.first)->second;
+        result.push_back(make_pair(id_object.second.model, bounding_rects[i++]));
+    }
 
-        glm::mat4 model_matrix = getModelMatrix(name_object.second);
+    return result;
+}
 
-        //Compute the bounding rect of the model (actually, of the model's convex hull)
-        glm::mat4 PVM_matrix = projection_view_matrix * model_matrix;
 
-        Rect bounding_rect;
-        for (glm::vec3 convex_hull_point : model.convexHullPoints)
+vector<Rect> SynthRenderer::projectBoundingRects(const vector<HullProjectionJob> &jobs) const
+{
+    //Bounds of the models' convex hulls in normalized device coordinates, all the objects in one pass
+    vector<ProjectedBounds> projected_bounds(jobs.size());
+    ProjectHulls(jobs.data(), jobs.size(), projected_bounds.data());
+
+    vector<Rect> bounding_rects(jobs.size());
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        const ProjectedBounds &bounds = projected_bounds[i];
+        Rect &bounding_rect = bounding_rects[i];
+        if (!bounds.visible)
         {
-            glm::vec4 projected_point = PVM_matrix * glm::vec4(convex_hull_point, 1.0f);
-            projected_point /= projected_point.w;
-            bounding_rect.updateBounds(projected_point.x, projected_point.y);
+            bounding_rect.bottom_left = glm::vec2(0.0f, 0.0f);
+            bounding_rect.top_right = glm::vec2(0.0f, 0.0f);
+            continue;
         }
 
         //Convert the bounding rect to image coordinates
-        bounding_rect.bottom_left.x = (1.0 + bounding_rect.bottom_left.x) / 2.0f * generate_image_width;
-        bounding_rect.bottom_left.y = (1.0 - bounding_rect.bottom_left.y) / 2.0f * generate_image_height;
+        bounding_rect.bottom_left.x = (1.0f + bounds.minX) / 2.0f * generate_image_width;
+        bounding_rect.bottom_left.y = (1.0f - bounds.minY) / 2.0f * generate_image_height;
 
-        bounding_rect.top_right.x = (1.0f + bounding_rect.top_right.x) / 2.0f * generate_image_width;
-        bounding_rect.top_right.y = (1.0f - bounding_rect.top_right.y) / 2.0f * generate_image_height;
-   
-        result.push_back(make_pair(name_object.first, bounding_rect));
+        bounding_rect.top_right.x = (1.0f + bounds.maxX) / 2.0f * generate_image_width;
+        bounding_rect.top_right.y = (1.0f - bounds.maxY) / 2.0f * generate_image_height;
     }
 
-    return result;
+    return bounding_rects;
 }
 
 
-SyntheticResult SynthRenderer::renderImage(
-        vector< pair<string, ObjectAttributes> > &models_to_attributes,
-        int background_image_index,
-        glm::vec3 camera_position,
-        glm::vec3 camera_target,
-        glm::vec3 camera_up,
-        glm::vec3 sun_light_direction,
-        glm::vec3 sun_light_color,
-        glm::vec3 ambient_light_color,
-        glm::vec3 search_light_color,
-        float search_light_angle,
-        bool generate_semantic_segmentation
-        )
+void SynthRenderer::beginScene(const SceneSettings &scene, glm::mat4 &projection, glm::mat4 &view, bool generate_labels)
 {
-    SyntheticResult synthetic_result;
+    //Background goes to the image only
+    glDrawBuffers(1, framebuffer_draw_buffers);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    drawBackground(scene.background_image_index);
+
+    if (generate_labels)
+    {
+        //Models are drawn into the image and all the label attachments at once
+        glDrawBuffers(framebuffer_attachments_count, framebuffer_draw_buffers);
+        clearLabelAttachments();
+    }
 
+    updateFrameUniforms(scene, projection, view);
+    model_shader.value().use();
+}
 
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_object);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    drawBackground(background_image_index);
+
+void SynthRenderer::clearLabelAttachments()
+{
+    //Integer attachments must be cleared with integer values
+    const GLuint zero_label[4] = {0, 0, 0, 0};
+    const GLfloat zero_depth[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    glClearBufferuiv(GL_COLOR, 1, zero_label);
+    glClearBufferuiv(GL_COLOR, 2, zero_label);
+    glClearBufferfv(GL_COLOR, 3, zero_depth);
+}
+
+
+unsigned int SynthRenderer::getLabelsWidth(unsigned int labels_downscale) const
+{
+    return std::max(1u, generate_image_width / labels_downscale);
+}
+
+
+unsigned int SynthRenderer::getLabelsHeight(unsigned int labels_downscale) const
+{
+    return std::max(1u, generate_image_height / labels_downscale);
+}
+
+
+void SynthRenderer::beginLabels(const SceneSettings &scene, glm::mat4 &projection, glm::mat4 &view, unsigned int labels_downscale)
+{
+    if (labels_downscale == 0)
+    {
+        throw runtime_error("Labels downscale must be at least 1");
+    }
+
+    //The projection keeps the aspect of the image, the reduced viewport scales the labels down
+    glViewport(0, 0, getLabelsWidth(labels_downscale), getLabelsHeight(labels_downscale));
+    glDrawBuffers(framebuffer_attachments_count, labels_draw_buffers);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    clearLabelAttachments();
+
+    updateFrameUniforms(scene, projection, view);
+}
+
+
+void SynthRenderer::updateFrameUniforms(const SceneSettings &scene, glm::mat4 &projection, glm::mat4 &view)
+{
     //Initialize the camera
-    Camera camera(camera_position, camera_target, camera_up);
-    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)generate_image_width / (float)generate_image_height, 0.1f, 100.0f);
-    glm::mat4 view = camera.GetViewMatrix();
+    Camera camera(scene.camera_position, scene.camera_target, scene.camera_up);
+    projection = glm::perspective(glm::radians(camera.Zoom), (float)generate_image_width / (float)generate_image_height, 0.1f, 100.0f);
+    view = camera.GetViewMatrix();
+
+    //Camera and lights go to the frame uniform buffer, shared by all the shaders
+    FrameUniforms frame_uniforms = {};
+    frame_uniforms.projection = projection;
+    frame_uniforms.view = view;
+    frame_uniforms.viewPos = glm::vec4(camera.Position, 1.0f);
+    frame_uniforms.searchLightPos = glm::vec4(camera.Position, 1.0f);
+    frame_uniforms.externalLightDir = glm::vec4(scene.sun_light_direction, 0.0f);
+    frame_uniforms.searchLightDir = glm::vec4(camera.Front, 0.0f);
+    frame_uniforms.external_light_color = glm::vec4(scene.sun_light_color, 1.0f);
+    frame_uniforms.ambient_light_color = glm::vec4(scene.ambient_light_color, 1.0f);
+    frame_uniforms.searchlight_color = glm::vec4(scene.search_light_color, 1.0f);
+    frame_uniforms.searchlight_cone_angle_sin = sin(scene.search_light_angle);
+    frame_uniform_buffer.Update(&frame_uniforms, sizeof(frame_uniforms));
+}
 
-    model_shader.value().use();
-    model_shader.value().setMat4("projection", projection);
-    model_shader.value().setMat4("view", view);
 
-    model_shader.value().setVec3("viewPos", camera.Position);
-    model_shader.value().setVec3("searchLightPos", camera.Position);
-    model_shader.value().setVec3("externalLightDir", sun_light_direction);
-    model_shader.value().setVec3("searchLightDir", camera.Front);
+void SynthRenderer::drawScene(const SceneSpec &scene, glm::mat4 &projection, glm::mat4 &view, bool generate_labels)
+{
+    beginScene(scene, projection, view, generate_labels);
+    drawModels(scene.objects, model_shader.value());  //Render synthetic image
+}
 
-    model_shader.value().setVec3("external_light_color", sun_light_color);
-    model_shader.value().setVec3("ambient_light_color", ambient_light_color);
-    model_shader.value().setVec3("searchlight_color", search_light_color);
 
-    model_shader.value().setFloat("searchlight_cone_angle_sin", sin(search_light_angle));
+static bool sameSceneSettings(const SceneSettings &a, const SceneSettings &b)
+{
+    return a.background_image_index == b.background_image_index &&
+            a.camera_position == b.camera_position && a.camera_target == b.camera_target && a.camera_up == b.camera_up &&
+            a.sun_light_direction == b.sun_light_direction && a.sun_light_color == b.sun_light_color &&
+            a.ambient_light_color == b.ambient_light_color && a.search_light_color == b.search_light_color &&
+            a.search_light_angle == b.search_light_angle;
+}
 
-    drawModels(models_to_attributes, model_shader.value());  //Render synthetic image
-    //Read the pixels from the framebuffer, so we can return and access them
-    auto pixels_buff_ptr = make_unique<GLubyte[]>(generate_image_width * generate_image_height * 3);
-    glReadPixels(0, 0, generate_image_width, generate_image_height, GL_RGB, GL_UNSIGNED_BYTE, pixels_buff_ptr.get());
 
-    //We are done with the framebuffer, bind default framebuffer now
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+void SynthRenderer::drawScene(Scene &scene, glm::mat4 &projection, glm::mat4 &view, bool generate_labels)
+{
+    syncScene(scene);
+    Scene::SceneLayer &dynamic_layer = scene.layers[Scene::DYNAMIC_LAYER];
+
+    //Background and static objects are rendered with all the labels once, every frame starts from their copy. The
+    //static layer is only (re)rendered once the settings are the same as in the previous frame: for a moving camera
+    //every frame would need a new one, which costs an extra pass and a copy per frame
+    bool static_layer_up_to_date = scene.static_layer_valid && sameSceneSettings(scene.settings, scene.static_layer_settings);
+    bool settings_repeated = scene.previous_frame_valid && sameSceneSettings(scene.settings, scene.previous_frame_settings);
+    scene.previous_frame_settings = scene.settings;
+    scene.previous_frame_valid = true;
+    if (scene.static_objects_count == 0 || !(static_layer_up_to_date || settings_repeated))
+    {
+        beginScene(scene.settings, projection, view, generate_labels);
+        scene.layers[Scene::STATIC_LAYER].render_queue.Submit(scene.geometry_VAOs, scene.instance_VBO);
+        dynamic_layer.render_queue.Submit(scene.geometry_VAOs, scene.instance_VBO);
+        return;
+    }
 
-    auto renered_image = Image(std::move(pixels_buff_ptr), generate_image_width, generate_image_height, 3);
-    synthetic_result.image = std::move(renered_image);         
-    
-    if (generate_semantic_segmentation)
+    if (!static_layer_up_to_date)
     {
+        renderStaticLayer(scene);
+    }
+    updateFrameUniforms(scene.settings, projection, view);
 
-        semantic_segmentation_shader.value().use();
-        semantic_segmentation_shader.value().setMat4("view", view);
-        semantic_segmentation_shader.value().setMat4("projection", projection);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, scene.static_layer_framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer_object);
+    unsigned int copied_attachments_count = generate_labels ? framebuffer_attachments_count : 1;
+    for (unsigned int i = 0; i < copied_attachments_count; ++i)
+    {
+        glReadBuffer(framebuffer_draw_buffers[i]);
+        glDrawBuffers(1, &framebuffer_draw_buffers[i]);
+        GLbitfield mask = i == 0 ? GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT : GL_COLOR_BUFFER_BIT;
+        glBlitFramebuffer(0, 0, generate_image_width, generate_image_height, 0, 0, generate_image_width, generate_image_height, mask, GL_NEAREST);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_object);
+    glDrawBuffers(copied_attachments_count, framebuffer_draw_buffers);
 
-        glBindFramebuffer(GL_FRAMEBUFFER, semantic_segmentation_framebuffer_object);
-        glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
-        drawModels(models_to_attributes, semantic_segmentation_shader.value());  //Render synthetic image
-        //We will interpret RGB colors of the pixels as 24-bit integer (semantic index)
-        auto pixels_buff_ptr = make_unique<GLubyte[]>(generate_image_width * generate_image_height * 3);
-        glReadPixels(0, 0, generate_image_width, generate_image_height, GL_RGB, GL_UNSIGNED_BYTE, pixels_buff_ptr.get());
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    model_shader.value().use();
+    dynamic_layer.render_queue.Submit(scene.geometry_VAOs, scene.instance_VBO);
+}
 
 
-bool has_non_zero = false;
-for (int i = 0; i < generate_image_width * generate_image_height * 3; i += 3)
+void SynthRenderer::renderStaticLayer(Scene &scene)
 {
-    if (pixels_buff_ptr[i] != 0 || pixels_buff_ptr[i + 1] != 0 || pixels_buff_ptr[i + 2] != 0)
+    if (scene.static_layer_framebuffer == 0)
     {
-        has_non_zero = true;
-        break;
+        glGenFramebuffers(1, &scene.static_layer_framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, scene.static_layer_framebuffer);
+        scene.static_layer_textures.resize(framebuffer_attachments_count);
+        createAttachmentTextures(scene.static_layer_textures.data(), scene.static_layer_rbo);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            throw runtime_error("Static layer framebuffer is not complete!");
+        };
     }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, scene.static_layer_framebuffer);
+    glm::mat4 projection, view;
+    beginScene(scene.settings, projection, view, true);
+    scene.layers[Scene::STATIC_LAYER].render_queue.Submit(scene.geometry_VAOs, scene.instance_VBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_object);
+
+    scene.static_layer_settings = scene.settings;
+    scene.static_layer_valid = true;
 }
-clog << "Segmentation has non zero: " << has_non_zero << endl;
 
-        auto semantic_image = Image(std::move(pixels_buff_ptr), generate_image_width, generate_image_height, 3);
-        synthetic_result.semantic_segmentation = std::move(semantic_image);         
+
+void SynthRenderer::syncScene(Scene &scene)
+{
+    if (scene.renderer == nullptr)
+    {
+        //VAOs belong to this context, so the scene stays with this renderer
+        scene.renderer = this;
+        glGenBuffers(1, &scene.instance_VBO);
+        for (unsigned int format = 0; format < VERTEX_FORMATS_COUNT; format++)
+        {
+            scene.geometry_VAOs[format] = resources->geometry_arenas[format].CreateVertexArray(scene.instance_VBO);
+        }
+        for (Scene::SceneLayer &layer : scene.layers)
+        {
+            layer.render_queue.SetMultiDrawIndirect(GLAD_GL_VERSION_4_3);
+        }
+    }
+    else if (scene.renderer != this)
+    {
+        throw runtime_error("Scene is rendered by another renderer");
+    }
+
+    for (const Scene::SceneLayer &layer : scene.layers)
+    {
+        for (size_t handle = resources->models.size(); handle < layer.instances_per_model.size(); ++handle)
+        {
+            if (!layer.instances_per_model[handle].empty())
+            {
+                throw runtime_error("Unknown model handle: " + std::to_string(handle));
+            }
+        }
     }
 
-    //Compute the bounding rects
-    glm::mat4 projection_view = projection * view;
-    vector< pair<string, Rect> > bounding_rects = computeObjectsBoundingRects(models_to_attributes, projection_view);
-    synthetic_result.object_name_to_bounding_rect = std::move(bounding_rects);
+    glBindBuffer(GL_ARRAY_BUFFER, scene.instance_VBO);
+    if (scene.layout_dirty || scene.queued_models_count != resources->models.size())
+    {
+        //Lay out the instances of each model of each layer as a contiguous range and collect the draws, as in drawModels
+        frame_instances.clear();
+        for (Scene::SceneLayer &layer : scene.layers)
+        {
+            layer.render_queue.Clear();
+            layer.model_base_instances.assign(layer.instances_per_model.size(), 0);
+            for (size_t handle = 0; handle < layer.instances_per_model.size(); ++handle)
+            {
+                const vector<InstanceData> &model_instances = layer.instances_per_model[handle];
+                GLuint base_instance = static_cast<GLuint>(frame_instances.size());
+                layer.model_base_instances[handle] = base_instance;
+                if (model_instances.empty())
+                {
+                    continue;
+                }
+                frame_instances.insert(frame_instances.end(), model_instances.begin(), model_instances.end());
+                resources->models[handle].Enqueue(layer.render_queue, model_shader.value(), static_cast<GLsizei>(model_instances.size()), base_instance);
+            }
+            layer.render_queue.Sort();
+        }
+        glBufferData(GL_ARRAY_BUFFER, frame_instances.size() * sizeof(InstanceData), frame_instances.data(), GL_DYNAMIC_DRAW);
 
-    return synthetic_result;
-};
+        scene.layout_dirty = false;
+        scene.queued_models_count = resources->models.size();
+    }
+    else
+    {
+        //Only the records of the changed objects are written
+        for (ObjectId object_id : scene.dirty_objects)
+        {
+            auto found = scene.objects.find(object_id);
+            if (found == scene.objects.end())
+            {
+                continue;
+            }
+            const Scene::SceneObject &object = found->second;
+            const Scene::SceneLayer &layer = scene.layers[object.layer];
+            GLintptr offset = (layer.model_base_instances[object.model] + object.instance_index) * sizeof(InstanceData);
+            glBufferSubData(GL_ARRAY_BUFFER, offset, sizeof(InstanceData), &layer.instances_per_model[object.model][object.instance_index]);
+        }
+    }
+
+    for (ObjectId object_id : scene.dirty_objects)
+    {
+        auto found = scene.objects.find(object_id);
+        if (found != scene.objects.end())
+        {
+            found->second.dirty = false;
+        }
+    }
+    scene.dirty_objects.clear();
+}
+
+
+void SynthRenderer::initReadbackObjects()
+{
+    readback_slots.resize(readback_ring_size);
+    for (auto& slot : readback_slots)
+    {
+        glGenBuffers(1, &slot.image_pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.image_pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, generate_image_width * generate_image_height * 3, NULL, GL_STREAM_READ);
+
+        glGenBuffers(1, &slot.semantic_segmentation_pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.semantic_segmentation_pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, generate_image_width * generate_image_height * sizeof(GLuint), NULL, GL_STREAM_READ);
+
+        glGenBuffers(1, &slot.instance_segmentation_pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.instance_segmentation_pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, generate_image_width * generate_image_height * sizeof(GLuint), NULL, GL_STREAM_READ);
+
+        glGenBuffers(1, &slot.depth_pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.depth_pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, generate_image_width * generate_image_height * sizeof(GLfloat), NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+
+ReadbackSlot& SynthRenderer::findReadbackSlot(long ticket)
+{
+    if (ticket < 0)
+    {
+        throw runtime_error("Invalid frame ticket " + std::to_string(ticket));
+    }
+
+    ReadbackSlot& slot = readback_slots[ticket % readback_ring_size];
+    if (slot.ticket != ticket)
+    {
+        throw runtime_error("Frame " + std::to_string(ticket) + " is not in flight (never submitted or already collected)");
+    }
+    return slot;
+}
+
+
+ReadbackSlot& SynthRenderer::acquireReadbackSlot()
+{
+    ReadbackSlot& slot = readback_slots[next_readback_ticket % readback_ring_size];
+    if (slot.ticket != -1)
+    {
+        throw runtime_error("All " + std::to_string(readback_ring_size) + " readback slots are busy, collect submitted frames first");
+    }
+    slot.has_label_statistics = false;
+    return slot;
+}
+
+
+long SynthRenderer::submitImage(
+        const SceneSpec &scene,
+        bool generate_labels
+        )
+{
+    checkModelHandles(scene.objects);
+    ReadbackSlot& slot = acquireReadbackSlot();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_object);
+    glm::mat4 projection, view;
+    drawScene(scene, projection, view, generate_labels);
+    if (generate_labels && label_statistics)
+    {
+        startLabelStatistics(slot, instanceClasses(scene.objects));
+    }
+    long ticket = startReadback(slot, true, generate_labels);
+
+    //Compute the bounding rects while GPU is busy
+    slot.objects_bounding_rects = computeObjectsBoundingRects(scene.objects, projection * view);
+    return ticket;
+}
+
+
+long SynthRenderer::submitImage(
+        Scene &scene,
+        bool generate_labels
+        )
+{
+    ReadbackSlot& slot = acquireReadbackSlot();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_object);
+    glm::mat4 projection, view;
+    drawScene(scene, projection, view, generate_labels);
+    if (generate_labels && label_statistics)
+    {
+        startLabelStatistics(slot, instanceClasses(scene));
+    }
+    long ticket = startReadback(slot, true, generate_labels);
+
+    slot.objects_bounding_rects = computeObjectsBoundingRects(scene, projection * view);
+    return ticket;
+}
+
+
+long SynthRenderer::submitLabels(const SceneSpec &scene, unsigned int labels_downscale)
+{
+    checkModelHandles(scene.objects);
+    ReadbackSlot& slot = acquireReadbackSlot();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_object);
+    glm::mat4 projection, view;
+    beginLabels(scene, projection, view, labels_downscale);
+    prepareModels(scene.objects, model_shader.value());
+    render_queue.Submit(geometry_VAOs, instance_VBO, &labels_shader.value());
+    if (label_statistics)
+    {
+        startLabelStatistics(slot, instanceClasses(scene.objects), labels_downscale);
+    }
+    long ticket = startReadback(slot, false, true, labels_downscale);
+
+    slot.objects_bounding_rects = computeObjectsBoundingRects(scene.objects, projection * view);
+    return ticket;
+}
+
+
+long SynthRenderer::submitLabels(Scene &scene, unsigned int labels_downscale)
+{
+    ReadbackSlot& slot = acquireReadbackSlot();
+
+    syncScene(scene);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_object);
+    glm::mat4 projection, view;
+    beginLabels(scene.settings, projection, view, labels_downscale);
+    //The static layer cache holds full size shaded images, so static objects are drawn as the others
+    for (Scene::SceneLayer &layer : scene.layers)
+    {
+        layer.render_queue.Submit(scene.geometry_VAOs, scene.instance_VBO, &labels_shader.value());
+    }
+    if (label_statistics)
+    {
+        startLabelStatistics(slot, instanceClasses(scene), labels_downscale);
+    }
+    long ticket = startReadback(slot, false, true, labels_downscale);
+
+    slot.objects_bounding_rects = computeObjectsBoundingRects(scene, projection * view);
+    return ticket;
+}
+
+
+vector<int> SynthRenderer::instanceClasses(const vector< pair<ModelHandle, ObjectAttributes> > &models_to_positions)
+{
+    vector<int> instance_classes(models_to_positions.size() + 1, 0);
+    for (size_t i = 0; i < models_to_positions.size(); ++i)
+    {
+        instance_classes[i + 1] = models_to_positions[i].second.semantic_class_id;
+    }
+    return instance_classes;
+}
+
+
+vector<int> SynthRenderer::instanceClasses(const Scene &scene)
+{
+    //Labels up to the largest id of the objects, ids are reused so there are about as many labels as objects
+    vector<int> instance_classes(scene.objects.empty() ? 1 : scene.objects.rbegin()->first + 2, 0);
+    for (const auto &id_object : scene.objects)
+    {
+        instance_classes[id_object.first + 1] = id_object.second.attributes.semantic_class_id;
+    }
+    return instance_classes;
+}
+
+
+void SynthRenderer::startLabelStatistics(ReadbackSlot &slot, vector<int> &&instance_classes, unsigned int labels_downscale)
+{
+    slot.has_label_statistics = true;
+    slot.instance_classes = std::move(instance_classes);
+    if (!label_statistics_shader.has_value())
+    {
+        //Without compute shaders the statistics are reduced from the read back labels
+        return;
+    }
+
+    //One record per instance label, zeroed before the reduction
+    const GLsizeiptr records_count = slot.instance_classes.size();
+    if (slot.label_statistics_ssbo == 0)
+    {
+        glGenBuffers(1, &slot.label_statistics_ssbo);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, slot.label_statistics_ssbo);
+    if (records_count > slot.label_statistics_capacity)
+    {
+        glBufferData(GL_SHADER_STORAGE_BUFFER, records_count * sizeof(LabelStatisticsRecord), NULL, GL_STREAM_READ);
+        slot.label_statistics_capacity = records_count;
+    }
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, records_count * sizeof(LabelStatisticsRecord), GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, slot.label_statistics_ssbo);
+
+    const unsigned int labels_width = getLabelsWidth(labels_downscale);
+    const unsigned int labels_height = getLabelsHeight(labels_downscale);
+    Shader &shader = label_statistics_shader.value();
+    shader.use();
+    shader.setInt("labels_width", labels_width);
+    shader.setInt("labels_height", labels_height);
+    shader.setInt("instances_count", records_count);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, instance_segmentation_texture_object);
+    glDispatchCompute((labels_width + 15) / 16, (labels_height + 15) / 16, 1);
+    //Records are mapped once the frame is collected
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+
+long SynthRenderer::startReadback(ReadbackSlot &slot, bool generate_image, bool generate_labels, unsigned int labels_downscale)
+{
+    long ticket = next_readback_ticket;
+    const unsigned int labels_width = getLabelsWidth(labels_downscale);
+    const unsigned int labels_height = getLabelsHeight(labels_downscale);
+
+    //Start transfer of the pixels into the slot's pixel buffers, glReadPixels returns without waiting for the GPU
+    if (generate_image)
+    {
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.image_pbo);
+        glReadPixels(0, 0, generate_image_width, generate_image_height, GL_RGB, GL_UNSIGNED_BYTE, 0);
+    }
+
+    if (generate_labels)
+    {
+        //Labels are read as they were written, one 32-bit integer per pixel
+        glReadBuffer(GL_COLOR_ATTACHMENT1);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.semantic_segmentation_pbo);
+        glReadPixels(0, 0, labels_width, labels_height, GL_RED_INTEGER, GL_UNSIGNED_INT, 0);
+
+        glReadBuffer(GL_COLOR_ATTACHMENT2);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.instance_segmentation_pbo);
+        glReadPixels(0, 0, labels_width, labels_height, GL_RED_INTEGER, GL_UNSIGNED_INT, 0);
+
+        glReadBuffer(GL_COLOR_ATTACHMENT3);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.depth_pbo);
+        glReadPixels(0, 0, labels_width, labels_height, GL_RED, GL_FLOAT, 0);
+
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glViewport(0, 0, generate_image_width, generate_image_height);
+    //We are done with the framebuffer, bind default framebuffer now
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+
+    slot.ticket = ticket;
+    slot.has_image = generate_image;
+    slot.has_labels = generate_labels;
+    slot.labels_width = labels_width;
+    slot.labels_height = labels_height;
+
+    next_readback_ticket++;
+    return ticket;
+}
+
+
+bool SynthRenderer::isImageReady(long ticket)
+{
+    ReadbackSlot& slot = findReadbackSlot(ticket);
+    GLint sync_status;
+    glGetSynciv(slot.fence, GL_SYNC_STATUS, sizeof(sync_status), NULL, &sync_status);
+    return sync_status == GL_SIGNALED;
+}
+
+
+//Maps the pixel buffer and copies its content into the destination array
+template <typename T>
+static void copyFromPixelBuffer(GLuint pbo, size_t elements_count, T *destination)
+{
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    const T* mapped_pixels = static_cast<const T*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, elements_count * sizeof(T), GL_MAP_READ_BIT));
+    if (mapped_pixels == nullptr)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        throw runtime_error("Failed to map pixel buffer");
+    }
+    std::copy(mapped_pixels, mapped_pixels + elements_count, destination);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+
+//Copies the pixel buffer into a buffer from the pool, released buffers return to the pool
+template <typename T>
+static HostBuffer<T> copyFromPixelBuffer(GLuint pbo, size_t elements_count, HostBufferPool &buffers_pool, bool page_locked)
+{
+    auto pixels_buff_ptr = buffers_pool.Acquire<T>(elements_count, page_locked);
+    copyFromPixelBuffer(pbo, elements_count, pixels_buff_ptr.get());
+    return pixels_buff_ptr;
+}
+
+
+SyntheticResult SynthRenderer::collectImage(long ticket, unsigned char *image_destination)
+{
+    ReadbackSlot& slot = findReadbackSlot(ticket);
+
+    GLenum wait_status;
+    do
+    {
+        wait_status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);  //1 second
+    } while (wait_status == GL_TIMEOUT_EXPIRED);
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+    slot.ticket = -1;
+
+    if (wait_status == GL_WAIT_FAILED)
+    {
+        throw runtime_error("Failed to wait for frame " + std::to_string(ticket));
+    }
+
+    const size_t pixels_count = generate_image_width * generate_image_height;
+    const size_t labels_pixels_count = slot.labels_width * slot.labels_height;
+    SyntheticResult synthetic_result;
+    if (!slot.has_image)
+    {
+        synthetic_result.image = Image(nullptr, 0, 0, 3);
+    }
+    else if (image_destination != nullptr)
+    {
+        //The caller owns the image buffer, the result image has no data
+        copyFromPixelBuffer<GLubyte>(slot.image_pbo, pixels_count * 3, image_destination);
+        synthetic_result.image = Image(nullptr, generate_image_width, generate_image_height, 3);
+    }
+    else
+    {
+        synthetic_result.image = Image(copyFromPixelBuffer<GLubyte>(slot.image_pbo, pixels_count * 3, *result_buffers_pool, page_locked_results), generate_image_width, generate_image_height, 3);
+    }
+    if (slot.has_labels)
+    {
+        //Unsigned labels are returned as signed integers, so negative semantic classes come back as they were given
+        synthetic_result.semantic_segmentation = LabelImage(copyFromPixelBuffer<int32_t>(slot.semantic_segmentation_pbo, labels_pixels_count, *result_buffers_pool, page_locked_results), slot.labels_width, slot.labels_height);
+        synthetic_result.instance_segmentation = LabelImage(copyFromPixelBuffer<int32_t>(slot.instance_segmentation_pbo, labels_pixels_count, *result_buffers_pool, page_locked_results), slot.labels_width, slot.labels_height);
+        synthetic_result.depth = DepthImage(copyFromPixelBuffer<GLfloat>(slot.depth_pbo, labels_pixels_count, *result_buffers_pool, page_locked_results), slot.labels_width, slot.labels_height);
+    }
+    if (slot.has_label_statistics)
+    {
+        synthetic_result.label_statistics = collectLabelStatistics(slot, synthetic_result.instance_segmentation.value());
+    }
+    synthetic_result.objects_bounding_rects = std::move(slot.objects_bounding_rects);
+
+    return synthetic_result;
+}
+
+
+LabelStatistics SynthRenderer::collectLabelStatistics(ReadbackSlot &slot, const LabelImage &instance_segmentation) const
+{
+    vector<LabelStatisticsRecord> records(slot.instance_classes.size(), LabelStatisticsRecord{});
+    if (label_statistics_shader.has_value())
+    {
+        copyFromPixelBuffer<LabelStatisticsRecord>(slot.label_statistics_ssbo, records.size(), records.data());
+    }
+    else
+    {
+        //Same reduction as compute_label_statistics.glsl, over the read back labels
+        for (unsigned int y = 0; y < instance_segmentation.height; ++y)
+        {
+            const int32_t *row = instance_segmentation.data.get() + (size_t)y * instance_segmentation.width;
+            for (unsigned int x = 0; x < instance_segmentation.width; ++x)
+            {
+                if (row[x] <= 0 || (size_t)row[x] >= records.size())
+                {
+                    continue;
+                }
+                LabelStatisticsRecord &record = records[row[x]];
+                record.inverted_min_x = std::max(record.inverted_min_x, ~x);
+                record.inverted_min_y = std::max(record.inverted_min_y, ~y);
+                record.max_x = std::max(record.max_x, x);
+                record.max_y = std::max(record.max_y, y);
+                record.pixels_count++;
+                uint64_t sum_x = ((uint64_t)record.sum_x_high << 32 | record.sum_x_low) + x;
+                uint64_t sum_y = ((uint64_t)record.sum_y_high << 32 | record.sum_y_low) + y;
+                record.sum_x_low = (GLuint)sum_x;
+                record.sum_x_high = (GLuint)(sum_x >> 32);
+                record.sum_y_low = (GLuint)sum_y;
+                record.sum_y_high = (GLuint)(sum_y >> 32);
+            }
+        }
+    }
+
+    //Labels may be smaller than the image, rows of the labels go from the bottom while image coordinates go from the top
+    const float scale_x = (float)generate_image_width / slot.labels_width;
+    const float scale_y = (float)generate_image_height / slot.labels_height;
+    LabelStatistics statistics;
+    unsigned int objects_pixels_count = 0;
+    for (size_t label = 1; label < records.size(); ++label)
+    {
+        const LabelStatisticsRecord &record = records[label];
+        if (record.pixels_count == 0)
+        {
+            continue;
+        }
+
+        ObjectLabelStatistics object;
+        object.instance_label = label;
+        object.semantic_class_id = slot.instance_classes[label];
+        object.pixels_count = record.pixels_count;
+        object.visible_rect.bottom_left = glm::vec2(~record.inverted_min_x * scale_x, (slot.labels_height - ~record.inverted_min_y) * scale_y);
+        object.visible_rect.top_right = glm::vec2((record.max_x + 1) * scale_x, (slot.labels_height - record.max_y - 1) * scale_y);
+        const double sum_x = (double)((uint64_t)record.sum_x_high << 32 | record.sum_x_low);
+        const double sum_y = (double)((uint64_t)record.sum_y_high << 32 | record.sum_y_low);
+        object.centroid = glm::vec2(
+                (sum_x / record.pixels_count + 0.5) * scale_x,
+                (slot.labels_height - (sum_y / record.pixels_count + 0.5)) * scale_y);
+
+        statistics.class_pixels_count[object.semantic_class_id] += record.pixels_count;
+        objects_pixels_count += record.pixels_count;
+        statistics.objects.push_back(object);
+    }
+    statistics.background_pixels_count = slot.labels_width * slot.labels_height - objects_pixels_count;
+    return statistics;
+}
+
+
+SyntheticResult SynthRenderer::renderImage(
+        const SceneSpec &scene,
+        bool generate_labels,
+        unsigned char *image_destination
+        )
+{
+    return collectImage(submitImage(scene, generate_labels), image_destination);
+};
+
+
+SyntheticResult SynthRenderer::renderImage(
+        Scene &scene,
+        bool generate_labels,
+        unsigned char *image_destination
+        )
+{
+    return collectImage(submitImage(scene, generate_labels), image_destination);
+}
+
+
+SyntheticResult SynthRenderer::renderLabels(const SceneSpec &scene, unsigned int labels_downscale)
+{
+    return collectImage(submitLabels(scene, labels_downscale));
+}
+
+
+SyntheticResult SynthRenderer::renderLabels(Scene &scene, unsigned int labels_downscale)
+{
+    return collectImage(submitLabels(scene, labels_downscale));
+}
+
+
+void SynthRenderer::initBatchObjects(unsigned int scenes_count)
+{
+    if (batch_framebuffer_object == 0)
+    {
+        glGenFramebuffers(1, &batch_framebuffer_object);
+        glGenTextures(1, &batch_texture_array_object);
+
+        //All layers share the same depth buffer, it is cleared before every scene
+        glGenRenderbuffers(1, &batch_rbo);
+        glBindRenderbuffer(GL_RENDERBUFFER, batch_rbo);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, generate_image_width, generate_image_height);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, batch_framebuffer_object);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, batch_rbo);
+    }
+
+    //Array texture is read back as a whole, so it must have exactly as many layers as there are scenes in the batch
+    if (batch_layers_count == scenes_count)
+    {
+        return;
+    }
+
+    GLint max_layers;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+    if (scenes_count > (unsigned int)max_layers)
+    {
+        throw runtime_error("Batch is too large, maximal number of scenes is " + std::to_string(max_layers));
+    }
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, batch_texture_array_object);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB8, generate_image_width, generate_image_height, scenes_count, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    batch_layers_count = scenes_count;
+}
+
+
+BatchResult SynthRenderer::renderBatch(const vector<SceneSpec> &scenes)
+{
+    for (const auto &scene : scenes)
+    {
+        checkModelHandles(scene.objects);
+    }
+
+    BatchResult batch_result;
+    batch_result.scenes_count = scenes.size();
+    if (scenes.empty())
+    {
+        batch_result.images = Image(nullptr, generate_image_width, generate_image_height, 3);
+        return batch_result;
+    }
+
+    initBatchObjects(scenes.size());
+
+    glBindFramebuffer(GL_FRAMEBUFFER, batch_framebuffer_object);
+    for (unsigned int i = 0; i < scenes.size(); ++i)
+    {
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, batch_texture_array_object, 0, i);
+        if (i == 0 && glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            throw runtime_error("Batch framebuffer is not complete!");
+        };
+
+        glm::mat4 projection, view;
+        drawScene(scenes[i], projection, view);
+        batch_result.objects_bounding_rects.push_back(computeObjectsBoundingRects(scenes[i].objects, projection * view));
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    batch_result.images = readBatchImages(scenes.size());
+    return batch_result;
+}
+
+
+Image SynthRenderer::readBatchImages(unsigned int layers_count)
+{
+    //Read all the layers back at once
+    auto pixels_buff_ptr = result_buffers_pool->Acquire<GLubyte>((size_t)layers_count * generate_image_width * generate_image_height * 3, page_locked_results);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, batch_texture_array_object);
+    glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels_buff_ptr.get());
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    return Image(std::move(pixels_buff_ptr), generate_image_width, generate_image_height, 3);
+}
+
+
+void SynthRenderer::renderTrajectory(
+        Scene &scene,
+        const vector<CameraView> &trajectory,
+        bool generate_labels,
+        const std::function<void(size_t, SyntheticResult&)> &frame_callback,
+        unsigned char *images_destination)
+{
+    const size_t image_bytes = (size_t)generate_image_width * generate_image_height * 3;
+    size_t submitted_count = 0;
+    size_t collected_count = 0;
+    long first_ticket = next_readback_ticket;
+
+    auto collectNext = [&]() {
+        unsigned char *image_destination = images_destination != nullptr ? images_destination + collected_count * image_bytes : nullptr;
+        SyntheticResult frame = collectImage(first_ticket + collected_count, image_destination);
+        frame_callback(collected_count++, frame);
+    };
+
+    try
+    {
+        //Frames are submitted as long as there is a free readback slot, the oldest one is collected otherwise
+        while (submitted_count < trajectory.size())
+        {
+            if (submitted_count - collected_count == readback_ring_size)
+            {
+                collectNext();
+            }
+
+            scene.settings.camera_position = trajectory[submitted_count].camera_position;
+            scene.settings.camera_target = trajectory[submitted_count].camera_target;
+            scene.settings.camera_up = trajectory[submitted_count].camera_up;
+            submitImage(scene, generate_labels);
+            submitted_count++;
+        }
+        while (collected_count < submitted_count)
+        {
+            collectNext();
+        }
+    }
+    catch (...)
+    {
+        //Free the readback slots of the frames still in flight, so the renderer stays usable
+        for (size_t i = collected_count; i < submitted_count; ++i)
+        {
+            ReadbackSlot& slot = readback_slots[(first_ticket + i) % readback_ring_size];
+            if (slot.ticket == (long)(first_ticket + i))
+            {
+                glDeleteSync(slot.fence);
+                slot.fence = nullptr;
+                slot.ticket = -1;
+            }
+        }
+        throw;
+    }
+}
+
+
+BatchResult SynthRenderer::renderViews(const SceneSpec &scene, const vector<CameraView> &views)
+{
+    checkModelHandles(scene.objects);
+
+    BatchResult batch_result;
+    batch_result.scenes_count = views.size();
+    if (views.empty())
+    {
+        batch_result.images = Image(nullptr, generate_image_width, generate_image_height, 3);
+        return batch_result;
+    }
+
+    initBatchObjects(views.size());
+
+    //Instances and draws of the objects are set up once, only camera changes from view to view
+    prepareModels(scene.objects, model_shader.value());
+
+    SceneSettings view_settings = scene;
+    vector<glm::mat4> projection_views;
+    projection_views.reserve(views.size());
+
+    glBindFramebuffer(GL_FRAMEBUFFER, batch_framebuffer_object);
+    for (unsigned int i = 0; i < views.size(); ++i)
+    {
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, batch_texture_array_object, 0, i);
+        if (i == 0 && glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            throw runtime_error("Batch framebuffer is not complete!");
+        };
+
+        view_settings.camera_position = views[i].camera_position;
+        view_settings.camera_target = views[i].camera_target;
+        view_settings.camera_up = views[i].camera_up;
+
+        glm::mat4 projection, view;
+        beginScene(view_settings, projection, view, false);
+        render_queue.Submit(geometry_VAOs, instance_VBO);
+        projection_views.push_back(projection * view);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    //Bounding rects are computed while the GPU renders the views
+    batch_result.objects_bounding_rects = computeObjectsBoundingRects(scene.objects, projection_views);
+
+    batch_result.images = readBatchImages(views.size());
+    return batch_result;
+}
+
+
+const vector<string>& SynthRenderer::getModelAliases() const
+{
+    return resources->model_aliases;
+}
+
+
+ModelHandle SynthRenderer::getModelHandle(const string &model_alias) const
+{
+    auto found = resources->model_handles.find(model_alias);
+    if (found == resources->model_handles.end())
+    {
+        throw runtime_error("Unknown model: " + model_alias);
+    }
+    return found->second;
+}
 
 
 vector< tuple<string, glm::vec3, glm::vec3>> SynthRenderer::getModelsExtent() const
 {
     vector< tuple<string, glm::vec3, glm::vec3> > models_to_extent;
-    for (const auto& model : models)
+    for (size_t handle = 0; handle < resources->models.size(); ++handle)
     {
+        const Model& model = resources->models[handle];
         glm::vec3 min(numeric_limits<float>::max(), numeric_limits<float>::max(), numeric_limits<float>::max());
-        glm::vec3 max(numeric_limits<float>::min(), numeric_limits<float>::min(), numeric_limits<float>::min());
+        glm::vec3 max(numeric_limits<float>::lowest(), numeric_limits<float>::lowest(), numeric_limits<float>::lowest());
         //Loop through convex hull of the model and find extent along all the axes
-        for (const auto& point : model.second.convexHullPoints)
+        for (const auto& point : model.convexHullPoints)
         {
                 min.x = std::min(min.x, point.x);
                 min.y = std::min(min.y, point.y);
@@ -414,7 +1609,7 @@ vector< tuple<string, glm::vec3, glm::vec3>> SynthRenderer::getModelsExtent() co
                 max.z = std::max(max.z, point.z);
         }
 
-        models_to_extent.push_back(make_tuple(model.first, min, max));
+        models_to_extent.push_back(make_tuple(resources->model_aliases[handle], min, max));
     }
 
     return models_to_extent;
@@ -0,0 +1,155 @@
+//Checks that every convex hull projection kernel the CPU can run gives the bounds of the scalar kernel
+#include <hull_projection.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+
+static int failures = 0;
+
+
+static void check(bool condition, const char *kernel, size_t hull, const char *what)
+{
+    if (!condition)
+    {
+        std::printf("FAILED: kernel %s, hull %zu: %s\n", kernel, hull, what);
+        failures++;
+    }
+}
+
+
+static bool close(float value, float expected)
+{
+    return std::abs(value - expected) <= 1e-4f * std::max(1.0f, std::abs(expected));
+}
+
+
+//OpenGL perspective projection, looking along -z
+static glm::mat4 perspective(float near_plane, float far_plane)
+{
+    glm::mat4 projection(0.0f);
+    projection[0][0] = 1.0f;
+    projection[1][1] = 1.333f;
+    projection[2][2] = -(far_plane + near_plane) / (far_plane - near_plane);
+    projection[2][3] = -1.0f;
+    projection[3][2] = -2.0f * far_plane * near_plane / (far_plane - near_plane);
+    return projection;
+}
+
+
+//Rotation about the y axis followed by a translation
+static glm::mat4 modelMatrix(float angle, const glm::vec3 &translation)
+{
+    glm::mat4 model(1.0f);
+    model[0][0] = std::cos(angle);
+    model[0][2] = -std::sin(angle);
+    model[2][0] = std::sin(angle);
+    model[2][2] = std::cos(angle);
+    model[3][0] = translation.x;
+    model[3][1] = translation.y;
+    model[3][2] = translation.z;
+    return model;
+}
+
+
+int main()
+{
+    std::mt19937 generator(1234);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+    //Hulls of all the sizes around the group size, in front of the near plane, crossing it and behind the camera
+    vector<HullPoints> hulls;
+    vector<glm::mat4> matrices;
+    vector<bool> in_front;
+    const glm::mat4 projection = perspective(0.1f, 100.0f);
+    for (size_t i = 0; i < 300; ++i)
+    {
+        const size_t count = i % (3 * HULL_POINTS_GROUP_SIZE + 1);
+        vector<glm::vec3> points;
+        for (size_t point = 0; point < count; ++point)
+        {
+            points.push_back(glm::vec3(unit(generator), unit(generator), unit(generator)));
+        }
+        hulls.push_back(HullPoints::FromPoints(points));
+
+        const glm::vec3 translation(3.0f * unit(generator), 3.0f * unit(generator), -4.0f + 5.0f * unit(generator));
+        matrices.push_back(projection * modelMatrix(3.14159265f * unit(generator), translation));
+
+        bool all_in_front = true;
+        for (const glm::vec3 &point : points)
+        {
+            const glm::vec4 clip_point = matrices.back() * glm::vec4(point.x, point.y, point.z, 1.0f);
+            all_in_front = all_in_front && clip_point.z + clip_point.w >= 0.0f;
+        }
+        in_front.push_back(all_in_front && count > 0);
+    }
+
+    vector<HullProjectionJob> jobs;
+    for (size_t i = 0; i < hulls.size(); ++i)
+    {
+        jobs.push_back(HullProjectionJob{&hulls[i], matrices[i]});
+    }
+
+    if (!SelectHullProjectionKernel("scalar"))
+    {
+        std::printf("FAILED: scalar kernel is not available\n");
+        return 1;
+    }
+    vector<ProjectedBounds> expected(jobs.size());
+    ProjectHulls(jobs.data(), jobs.size(), expected.data());
+
+    //The scalar kernel itself against the projected points of hulls which are entirely in front of the near plane
+    for (size_t i = 0; i < hulls.size(); ++i)
+    {
+        if (hulls[i].count == 0)
+        {
+            check(!expected[i].visible, "scalar", i, "empty hull is visible");
+            continue;
+        }
+        if (!in_front[i])
+        {
+            continue;
+        }
+        float min_x = INFINITY, min_y = INFINITY, max_x = -INFINITY, max_y = -INFINITY;
+        for (size_t point = 0; point < hulls[i].count; ++point)
+        {
+            const glm::vec4 clip_point = matrices[i] * glm::vec4(hulls[i].x[point], hulls[i].y[point], hulls[i].z[point], 1.0f);
+            min_x = std::min(min_x, clip_point.x / clip_point.w);
+            min_y = std::min(min_y, clip_point.y / clip_point.w);
+            max_x = std::max(max_x, clip_point.x / clip_point.w);
+            max_y = std::max(max_y, clip_point.y / clip_point.w);
+        }
+        check(expected[i].visible, "scalar", i, "hull in front of the near plane is not visible");
+        check(close(expected[i].minX, min_x) && close(expected[i].minY, min_y) &&
+              close(expected[i].maxX, max_x) && close(expected[i].maxY, max_y), "scalar", i, "bounds of the projected points");
+    }
+
+    for (const char *kernel : SupportedHullProjectionKernels())
+    {
+        SelectHullProjectionKernel(kernel);
+        check(std::string(HullProjectionKernelName()) == kernel, kernel, 0, "kernel is not selected");
+
+        vector<ProjectedBounds> bounds(jobs.size());
+        ProjectHulls(jobs.data(), jobs.size(), bounds.data());
+        for (size_t i = 0; i < bounds.size(); ++i)
+        {
+            check(bounds[i].visible == expected[i].visible, kernel, i, "visibility differs from the scalar kernel");
+            if (bounds[i].visible && expected[i].visible)
+            {
+                check(close(bounds[i].minX, expected[i].minX) && close(bounds[i].minY, expected[i].minY) &&
+                      close(bounds[i].maxX, expected[i].maxX) && close(bounds[i].maxY, expected[i].maxY),
+                      kernel, i, "bounds differ from the scalar kernel");
+            }
+        }
+        std::printf("kernel %s checked\n", kernel);
+    }
+
+    SelectHullProjectionKernel(SupportedHullProjectionKernels().front());
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,204 @@
+//Checks that simplified convex hulls have at most the requested vertices and enclose all the points of the hull
+#include <hull_projection.h>
+#include <quickhull/QuickHull.hpp>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+
+static int failures = 0;
+
+
+static void check(bool condition, const char *shape, const HullSimplification &simplification, const char *what)
+{
+    if (!condition)
+    {
+        std::printf("FAILED: %s, %u vertices, tolerance %g: %s\n", shape, simplification.maxVertices,
+                    simplification.tolerance, what);
+        failures++;
+    }
+}
+
+
+//True when all the points are behind every face plane of the convex hull of the vertices (up to rounding)
+static bool encloses(const vector<glm::vec3> &vertices, const vector<glm::vec3> &points)
+{
+    std::vector<quickhull::Vector3<float>> hull_input;
+    for (const glm::vec3 &vertex : vertices)
+    {
+        hull_input.push_back(quickhull::Vector3<float>(vertex.x, vertex.y, vertex.z));
+    }
+    quickhull::QuickHull<float> qh;
+    auto hull = qh.getConvexHull(hull_input, true, false);
+    const auto &hull_vertices = hull.getVertexBuffer();
+    const auto &hull_indices = hull.getIndexBuffer();
+
+    vector<glm::vec3> corners;
+    glm::vec3 centroid(0.0f);
+    for (const auto &vertex : hull_vertices)
+    {
+        corners.push_back(glm::vec3(vertex.x, vertex.y, vertex.z));
+        centroid += corners.back();
+    }
+    centroid /= static_cast<float>(corners.size());
+    float size = 0.0f;
+    for (const glm::vec3 &corner : corners)
+    {
+        size = std::max(size, glm::length(corner - centroid));
+    }
+
+    for (size_t i = 0; i + 2 < hull_indices.size(); i += 3)
+    {
+        const glm::vec3 &a = corners[hull_indices[i]];
+        glm::vec3 normal = glm::cross(corners[hull_indices[i + 1]] - a, corners[hull_indices[i + 2]] - a);
+        if (glm::dot(normal, a - centroid) < 0.0f)
+        {
+            normal = -normal;
+        }
+        normal /= glm::length(normal);
+        for (const glm::vec3 &point : points)
+        {
+            if (glm::dot(normal, point - a) > 1e-4f * size)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+//True when all the points are inside the bounding box of the vertices, for flat hulls which have no volume to check
+static bool boundsEnclose(const vector<glm::vec3> &vertices, const vector<glm::vec3> &points)
+{
+    for (const glm::vec3 &point : points)
+    {
+        bool below_x = true, above_x = true, below_y = true, above_y = true, below_z = true, above_z = true;
+        for (const glm::vec3 &vertex : vertices)
+        {
+            below_x = below_x && point.x < vertex.x;
+            above_x = above_x && point.x > vertex.x;
+            below_y = below_y && point.y < vertex.y;
+            above_y = above_y && point.y > vertex.y;
+            below_z = below_z && point.z < vertex.z;
+            above_z = above_z && point.z > vertex.z;
+        }
+        if (below_x || above_x || below_y || above_y || below_z || above_z)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+//Vertices of the convex hull of the points, like the models' hulls the simplification gets
+static vector<glm::vec3> convexHull(const vector<glm::vec3> &points)
+{
+    std::vector<quickhull::Vector3<float>> hull_input;
+    for (const glm::vec3 &point : points)
+    {
+        hull_input.push_back(quickhull::Vector3<float>(point.x, point.y, point.z));
+    }
+    quickhull::QuickHull<float> qh;
+    auto hull = qh.getConvexHull(hull_input, true, false);
+    vector<glm::vec3> vertices;
+    for (const auto &vertex : hull.getVertexBuffer())
+    {
+        vertices.push_back(glm::vec3(vertex.x, vertex.y, vertex.z));
+    }
+    return vertices;
+}
+
+
+int main()
+{
+    std::mt19937 generator(1234);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+    //Hulls of a sphere, a long box and a flat disc
+    vector<glm::vec3> sphere;
+    vector<glm::vec3> box;
+    vector<glm::vec3> disc;
+    for (size_t i = 0; i < 2000; ++i)
+    {
+        const glm::vec3 point(unit(generator), unit(generator), unit(generator));
+        if (glm::length(point) > 0.0f)
+        {
+            sphere.push_back((1.0f / glm::length(point)) * point);
+        }
+        box.push_back(glm::vec3(10.0f * point.x, 0.5f * point.y, 2.0f * point.z + 5.0f));
+        disc.push_back(glm::vec3(point.x, point.y, 0.0f));
+    }
+    sphere = convexHull(sphere);
+    box = convexHull(box);
+
+    //Axis aligned cube, whose vertices tie along the axis directions, and a cube with the vertices of a 5x5x5 grid on
+    //its faces, where whole rows of points tie along the axes and the lattice directions
+    vector<glm::vec3> cube;
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        cube.push_back(glm::vec3((corner & 1) ? 1.0f : -1.0f, (corner & 2) ? 1.0f : -1.0f, (corner & 4) ? 1.0f : -1.0f));
+    }
+    vector<glm::vec3> grid_cube;
+    for (int x = 0; x < 5; ++x)
+    {
+        for (int y = 0; y < 5; ++y)
+        {
+            for (int z = 0; z < 5; ++z)
+            {
+                if (x == 0 || x == 4 || y == 0 || y == 4 || z == 0 || z == 4)
+                {
+                    grid_cube.push_back(glm::vec3(0.5f * x - 1.0f, 0.5f * y - 1.0f, 0.5f * z + 2.0f));
+                }
+            }
+        }
+    }
+
+    const HullSimplification unchanged;
+    check(SimplifyHull(sphere, unchanged).size() == sphere.size(), "sphere", unchanged, "hull is changed with 0 vertices");
+
+    const unsigned int max_vertices[] = {1, 4, 8, 12, 16, 32, 64};
+    const float tolerances[] = {0.0f, 0.05f, 0.5f};
+    for (unsigned int vertices : max_vertices)
+    {
+        for (float tolerance : tolerances)
+        {
+            HullSimplification simplification;
+            simplification.maxVertices = vertices;
+            simplification.tolerance = tolerance;
+
+            const pair<const char*, const vector<glm::vec3>*> hulls[] = {
+                    {"sphere", &sphere}, {"box", &box}, {"cube", &cube}, {"grid cube", &grid_cube}};
+            for (const auto &hull : hulls)
+            {
+                const vector<glm::vec3> simplified = SimplifyHull(*hull.second, simplification);
+                if (hull.second->size() <= std::max(vertices, 4u))
+                {
+                    check(simplified.size() == hull.second->size(), hull.first, simplification, "small enough hull is changed");
+                    continue;
+                }
+                check(simplified.size() <= std::max(vertices, 4u), hull.first, simplification, "too many vertices");
+                check(simplified.size() >= 4, hull.first, simplification, "too few vertices to enclose anything");
+                check(encloses(simplified, *hull.second), hull.first, simplification, "points outside the simplified hull");
+            }
+
+            const vector<glm::vec3> simplified_disc = SimplifyHull(disc, simplification);
+            check(simplified_disc.size() <= std::max(vertices, 4u), "disc", simplification, "too many vertices");
+            check(boundsEnclose(simplified_disc, disc), "disc", simplification, "points outside the simplified hull");
+        }
+    }
+
+    //Hulls which are small enough already are kept
+    HullSimplification large;
+    large.maxVertices = static_cast<unsigned int>(box.size());
+    check(SimplifyHull(box, large).size() == box.size(), "box", large, "small enough hull is changed");
+
+    std::printf("%s\n", failures == 0 ? "hull simplification checked" : "hull simplification failed");
+    return failures == 0 ? 0 : 1;
+}